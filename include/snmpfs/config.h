@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -51,20 +52,60 @@ namespace snmpfs {
 		std::string authPassphrase;			///< Password for authentication
 		DevicePrivAlgorithm privAlgorithm;	///< e.g. AES
 		std::string privPassphrase;			///< Password for privacy (encryption)
+
+		bool operator==(const AuthData&) const = default;
 	};
 
 	struct ConfigEntry {
 		std::string name;					///< name in filesystem
 		std::string rawOID;					///< unparsed OID
 		int32_t interval;					///< update interval in seconds
+
+		bool operator==(const ConfigEntry&) const = default;
 	};
 
 	struct ObjectConfig : ConfigEntry {
 		// Fields from ConfigEntry
 		ObjectType type		= SCALAR;
+		uint32_t maxAge		= 0;			///< age in seconds after which a read refreshes the data (0 = never)
+		uint32_t minInterval	= 0;		///< lower bound in seconds for adaptive polling (0 = interval)
+		uint32_t maxInterval	= 0;		///< upper bound in seconds for adaptive polling (0 = interval)
 		std::vector<ConfigEntry> columns;	///< TABLE ONLY
 		bool prefix			= false;		///< REUSE ONLY
 		bool placeholder	= false;		///< TREE ONLY
+		bool directory		= false;		///< TABLE (and tables below a TREE), additionally expose columns, rows and cells as files
+		bool skipUnread		= false;		///< TABLE (and tables below a TREE), do not poll columns that were not read recently
+
+		bool operator==(const ObjectConfig&) const = default;
+	};
+
+	/**
+	 * Objects of a Device. Devices defined the same way share a single list,
+	 * it is only copied once a Device changes it through edit.
+	 */
+	class ObjectList
+	{
+	public:
+		ObjectList() : objects(std::make_shared<std::vector<ObjectConfig>>()) {}
+		ObjectList(std::vector<ObjectConfig> objects) : objects(std::make_shared<std::vector<ObjectConfig>>(std::move(objects))) {}
+
+		const std::vector<ObjectConfig>& get() const				{ return *objects; }
+		std::vector<ObjectConfig>::const_iterator begin() const		{ return objects->begin(); }
+		std::vector<ObjectConfig>::const_iterator end() const		{ return objects->end(); }
+		size_t size() const											{ return objects->size(); }
+		bool empty() const											{ return objects->empty(); }
+
+		std::vector<ObjectConfig>& edit()
+		{
+			if(objects.use_count() > 1)
+				objects = std::make_shared<std::vector<ObjectConfig>>(*objects);
+			return *objects;
+		}
+
+		bool operator==(const ObjectList& other) const { return objects == other.objects || *objects == *other.objects; }
+
+	private:
+		std::shared_ptr<std::vector<ObjectConfig>> objects;
 	};
 
 	struct TemplateConfig {
@@ -79,6 +120,7 @@ namespace snmpfs {
 	struct TrapConfig {
 		AuthData auth;
 		uint16_t port;
+		uint32_t threads;					///< receiver threads sharing the port
 
 		// TODO Enable certain handlers (LogHandler, DeviceHandler, AlertHandler, ...)
 	};
@@ -88,12 +130,16 @@ namespace snmpfs {
 		std::string name;				///< name in filesystem
 		std::string peername;			///< name or address of default peer (may include transport specifier and/or port number)
 		int32_t interval;
+		uint32_t walkConcurrency;		///< maximum number of subtrees walked in parallel during initialization
+		uint32_t parkAfter;				///< objects unread for this many intervals are no longer polled (0 = never)
 		// TODO custom path
 
 		AuthData auth;					///< authentication data
 
 		// OBJECTS
-		std::vector<ObjectConfig> objects;
+		ObjectList objects;
+
+		bool operator==(const DeviceConfig&) const = default;
 	};
 
 	struct snmpfsConfig {
@@ -101,7 +147,12 @@ namespace snmpfs {
 		std::filesystem::path mountPoint;
 
 		int32_t interval;
+		uint32_t parkAfter;
+		uint32_t workers;				///< size of the TaskManagers worker pool
+		uint32_t initConcurrency;		///< maximum number of devices initialized in parallel
 		bool loadSystemMIBs;
+		bool selectiveMIBs;				///< only load MIB modules needed for the configured OIDs
+		std::filesystem::path mibCache;	///< compiled MIB index, reused while no MIB file changes
 
 		std::vector<DeviceConfig> devices;
 		std::vector<std::filesystem::path> mibs;
@@ -6,6 +6,8 @@
 #include <tinyxml2.h>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace snmpfs {
@@ -48,12 +50,28 @@ namespace snmpfs {
 		static bool readTable(tinyxml2::XMLElement* tableElement, ObjectConfig& config);
 		static bool readTrap(tinyxml2::XMLElement* trapElement, TrapConfig& config);
 
-		static bool replaceTemplates(const std::vector<TemplateConfig>& templates, DeviceConfig& device);
+		/**
+		 * Templates by name and the objects of templates with all nested templates already replaced.
+		 * Every template is expanded only once, devices defined the same way share a single expanded ObjectList.
+		 */
+		struct TemplateCache {
+			using DeviceKey = std::pair<int32_t, std::vector<ObjectConfig>>;	///< interval and objects of a device before expanding
+			struct DeviceKeyHash {
+				size_t operator()(const DeviceKey& key) const;
+			};
+
+			std::unordered_map<std::string, const TemplateConfig*> templates;
+			std::unordered_map<std::string, std::vector<ObjectConfig>> expanded;
+			std::unordered_set<std::string> expanding;	///< templates currently expanded, to detect cycles
+			std::unordered_map<DeviceKey, ObjectList, DeviceKeyHash> devices;
+		};
+
+		static bool replaceTemplates(TemplateCache& cache, DeviceConfig& device);
+		static const std::vector<ObjectConfig>* expandTemplate(TemplateCache& cache, const std::string& name);
+		static bool appendObjects(TemplateCache& cache, const std::vector<ObjectConfig>& objects, std::vector<ObjectConfig>& expanded);
 
 		static bool checkDuplicates(const DeviceConfig& device);
-		static bool checkName(const std::vector<ObjectConfig>& objects, const ObjectConfig& object);
-		static bool checkName(const snmpfsConfig& snmpfsConfig, const DeviceConfig& device);
-		static bool checkName(const snmpfsConfig& snmpfsConfig, const TemplateConfig& tmpt);
+		static bool checkName(std::unordered_set<std::string>& names, const std::string& name, const char* kind);
 	};
 
 }	// namespace snmpfs
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+namespace snmpfs {
+
+	class TaskManager;
+
+	/**
+	 * Defers freeing of things removed while filesystem calls might still use them.
+	 * Every call enters the current epoch, burying starts a new one.
+	 * Buried entries are freed once all calls that entered up to their epoch have left,
+	 * entries used by Tasks additionally wait until the Tasks running back then have returned.
+	 */
+	class Graveyard
+	{
+	public:
+		Graveyard(TaskManager* taskManager = nullptr);
+		~Graveyard();
+
+		uint64_t enter();
+		void leave(uint64_t epoch);
+
+		void bury(std::function<void()> free, bool usedByTasks = false);
+		size_t collect();
+		void clear();
+		size_t size() const;
+
+	private:
+		struct Grave {
+			uint64_t epoch;
+			bool usedByTasks;
+			uint64_t checkpoint;			///< of the TaskManager when buried
+			std::function<void()> free;
+		};
+
+		TaskManager* taskManager;
+		mutable std::mutex mutex;
+		uint64_t epoch = 0;
+		std::map<uint64_t, size_t> visitors;	///< calls inside per epoch
+		std::deque<Grave> graves;				///< ordered by epoch
+	};
+
+	/**
+	 * Stays inside the Graveyard for its lifetime
+	 */
+	class GraveyardGuard
+	{
+	public:
+		GraveyardGuard(Graveyard& graveyard) : graveyard(graveyard), epoch(graveyard.enter()) {}
+		~GraveyardGuard() { graveyard.leave(epoch); }
+
+	private:
+		Graveyard& graveyard;
+		const uint64_t epoch;
+	};
+
+}	// namespace snmpfs
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <stdint.h>
 #include <thread>
 #include <set>
+#include <vector>
 
 namespace snmpfs {
 
+	struct ProcData;
+
 	/**
 	 * Abstract class representing a single Task.
 	 * Tasks can either be one time execution SINGLE, or RECURRENT
@@ -34,6 +39,17 @@ namespace snmpfs {
 		void setInterval(uint32_t interval);
 		uint64_t getLastUpdate() const;
 
+		/**
+		 * Tasks with equal affinity are preferably executed by the same worker,
+		 * together with the interval it also determines the phase of RECURRENT Tasks
+		 */
+		virtual size_t getAffinity() const;
+
+		/**
+		 * Called by TaskManager::stop while the Task is running, long running Tasks should return soon after
+		 */
+		virtual void cancel();
+
 	protected:
 		uint32_t interval = 0;
 
@@ -42,6 +58,8 @@ namespace snmpfs {
 		Status status = WAITING;
 		const Type type;
 		uint64_t lastUpdate = 0;
+		uint64_t deadline = 0;		///< next execution while scheduled by a TaskManager
+		uint64_t enqueued = 0;		///< time the Task was handed to the workers
 
 		void execute();
 		virtual void run() = 0;
@@ -50,7 +68,10 @@ namespace snmpfs {
 	};
 
 	/**
-	* The TaskManagers job is to execute Tasks, expecially when they are RECURRENT
+	* The TaskManagers job is to execute Tasks, expecially when they are RECURRENT.
+	* Waiting Tasks are ordered by their deadline, the scheduler sleeps until the earliest one is due.
+	* Due Tasks are put into the run queue of the worker their affinity maps to,
+	* idle workers steal Tasks from the queues of busy ones.
 	*/
 	class TaskManager
 	{
@@ -63,8 +84,10 @@ namespace snmpfs {
 		const std::set<Task*> getTasks() const;
 		size_t size() const;
 		bool isIdle() const;
+		uint64_t checkpoint() const;
+		bool hasPassed(uint64_t checkpoint) const;
 
-		void start();
+		void start(size_t workers, ProcData* proc = nullptr);
 		void stop();
 		void join();
 
@@ -74,9 +97,31 @@ namespace snmpfs {
 		bool running = false;
 		std::thread thread;
 		mutable std::mutex taskMutex;
+		std::condition_variable taskCondition;
 		std::set<Task*> tasks;
-
+		std::set<std::pair<uint64_t, Task*>> deadlines;		///< waiting Tasks ordered by deadline
+		double schedulerLag = 0;			///< average delay between deadline and dispatch in ms
+
+		// WORKER POOL
+		struct Worker {
+			std::thread thread;
+			std::condition_variable condition;
+			std::deque<Task*> queue;		///< due Tasks assigned to this worker
+			Task* current = nullptr;		///< Task currently executed
+			uint64_t execution = 0;			///< number of the current execution (see checkpoint)
+			bool busy	= false;			///< currently executing a Task
+			bool woken	= false;			///< notified to steal but not yet running
+		};
+		std::vector<Worker> workers;
+		size_t queued = 0;					///< due Tasks in all worker queues
+		uint64_t executions = 0;			///< executions started so far
+		ProcData* proc = nullptr;			///< receives queue length and wait time if set
+
+		void schedule(Task* task);
+		void dispatch(Task* task);
+		bool canSteal(size_t worker) const;
 		void run();
+		void work(size_t worker);
 	};
 
 }	// namespace snmpfs
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <stdint.h>
 #include <vector>
@@ -9,6 +11,7 @@
  * Timed Queue
  * Values are added to the queue with a specified time value at which they expire.
  * Until this time is reached they can't be retrieved from the queue.
+ * Entries are kept in a binary heap ordered by time, equal times keep their insertion order.
  */
 template <typename T>
 class tqueue {
@@ -17,6 +20,7 @@ private:
 	struct tqueue_entry {
 		uint64_t delay;
 		uint64_t time;
+		uint64_t sequence;
 		T* value;
 	};
 
@@ -32,39 +36,52 @@ public:
 		return entries.empty();
 	}
 
+	size_t size() const
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return entries.size();
+	}
+
 	T* awaitNext()
 	{
 		T* nextT;
 		uint64_t delay;
-		next(&nextT, &delay);
+		awaitNext(&nextT, &delay);
 		return nextT;
 	}
 
+	/**
+	 * Blocks until the first entry expires and removes it, an empty queue is waited on as well.
+	 * Returns false as soon as the queue gets closed.
+	 */
 	bool awaitNext(T** valuePtr, uint64_t* delayPtr)
 	{
-		while(true)
-		{
-			std::unique_lock<std::mutex> lock(mutex);
+		std::unique_lock<std::mutex> lock(mutex);
+		*valuePtr = nullptr;
+		*delayPtr = 0;
 
+		while(!closed)
+		{
 			if(entries.empty())
 			{
-				*valuePtr = nullptr;
-				*delayPtr = 0;
-				return false;
+				condition.wait(lock);
+				continue;
 			}
 
-			const tqueue_entry& entry = entries[0];
-			if(entry.time <= now())
+			uint64_t current = now();
+			const tqueue_entry& entry = entries.front();
+			if(entry.time <= current)
 			{
 				*delayPtr = entry.delay;
 				*valuePtr = entry.value;
-				entries.erase(entries.begin());
+				remove();
 				return true;
 			}
 
-			lock.unlock();
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			// Woken early by push of an earlier entry or close
+			condition.wait_for(lock, std::chrono::milliseconds(entry.time - current));
 		}
+		return false;
 	}
 
 	T* next()
@@ -86,12 +103,12 @@ public:
 			return false;
 		}
 
-		const tqueue_entry& entry = entries[0];
+		const tqueue_entry& entry = entries.front();
 		if(entry.time <= now())
 		{
 			*delayPtr = entry.delay;
 			*valuePtr = entry.value;
-			entries.erase(entries.begin());
+			remove();
 			return true;
 		}
 		else
@@ -121,10 +138,10 @@ public:
 			return false;
 		}
 
-		const tqueue_entry& entry = entries[0];
+		const tqueue_entry& entry = entries.front();
 		*delayPtr = entry.delay;
 		*valuePtr = entry.value;
-		entries.erase(entries.begin());
+		remove();
 		return true;
 	}
 
@@ -134,36 +151,72 @@ public:
 		if(entries.empty())
 			return false;
 
-		const tqueue_entry& entry = entries[0];
+		const tqueue_entry& entry = entries.front();
 		return entry.time > now();
 	}
 
 	void push(T* value)
 	{
 		std::unique_lock<std::mutex> lock(mutex);
-		entries.emplace_back(0, now(), value);
-		sort();
+		insert(0, now(), value);
 	}
 
 	void pushAt(T* value, uint64_t time)
 	{
 		std::unique_lock<std::mutex> lock(mutex);
-		entries.emplace_back(time - now(), time, value);
-		sort();
+		uint64_t current = now();
+		insert(time > current ? time - current : 0, time, value);
 	}
 
 	void pushIn(T* value, uint64_t delay)
 	{
 		std::unique_lock<std::mutex> lock(mutex);
-		entries.emplace_back(delay, now() + delay, value);
-		sort();
+		insert(delay, now() + delay, value);
+	}
+
+	/**
+	 * Makes the entry of value expire immediately, it is retrieved before all entries that were not promoted.
+	 * Returns false if value is not in the queue.
+	 */
+	bool promote(T* value)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it = std::find_if(entries.begin(), entries.end(), [value](const tqueue_entry& entry) { return entry.value == value; });
+		if(it == entries.end())
+			return false;
+
+		// Time only decreases, sifting up restores the heap
+		it->time = 0;
+		std::push_heap(entries.begin(), it + 1, compare);
+		condition.notify_all();
+		return true;
+	}
+
+	/**
+	 * Wakes all threads blocked in awaitNext, further calls return immediately.
+	 * Entries stay in the queue and can still be retrieved via pop.
+	 */
+	void close()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		closed = true;
+		condition.notify_all();
+	}
+
+	bool isClosed() const
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return closed;
 	}
 
 	void print()
 	{
 		std::unique_lock<std::mutex> lock(mutex);
 
-		for(const tqueue_entry& entry : entries)
+		std::vector<tqueue_entry> sorted = entries;
+		std::sort_heap(sorted.begin(), sorted.end(), compare);
+		std::reverse(sorted.begin(), sorted.end());
+		for(const tqueue_entry& entry : sorted)
 		{
 			printf("%16lu: %p\n", entry.time, (void*) entry.value);
 		}
@@ -179,16 +232,34 @@ public:
 
 private:
 	mutable std::mutex mutex;
-	std::vector<tqueue_entry> entries;
+	std::condition_variable condition;
+	std::vector<tqueue_entry> entries;		///< min-heap by time and sequence
+	uint64_t sequence = 0;
+	bool closed = false;
 
+	/**
+	 * Heap comparator, the entry expiring first ends up at the front
+	 */
 	static bool compare(const tqueue_entry& e0, const tqueue_entry& e1)
 	{
-		return e0.time < e1.time;
+		if(e0.time != e1.time) return e0.time > e1.time;
+		return e0.sequence > e1.sequence;
+	}
+
+	void insert(uint64_t delay, uint64_t time, T* value)
+	{
+		entries.push_back({delay, time, sequence++, value});
+		std::push_heap(entries.begin(), entries.end(), compare);
+
+		// Waiting threads might have to wake up earlier
+		if(entries.front().sequence == sequence - 1)
+			condition.notify_all();
 	}
 
-	void sort()
+	void remove()
 	{
-		std::sort(entries.begin(), entries.end(), compare);
+		std::pop_heap(entries.begin(), entries.end(), compare);
+		entries.pop_back();
 	}
 
 };
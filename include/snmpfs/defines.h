@@ -13,5 +13,10 @@ namespace snmpfs {
 	inline std::string	APP_VERSION			= std::to_string(APP_VERSION_MAJOR) + "." + std::to_string(APP_VERSION_MINOR) + "." + std::to_string(APP_VERSION_PATCH);
 
 	inline int32_t DEFAULT_INTERVAL			= 5 * 60;
+	inline uint32_t DEFAULT_WALK_CONCURRENCY	= 4;
+	inline uint32_t DEFAULT_PARK_AFTER			= 0;	///< intervals without reads before an object is parked (0 = never)
+	inline uint32_t DEFAULT_WORKERS				= 8;	///< threads executing due Tasks
+	inline uint32_t DEFAULT_INIT_CONCURRENCY	= 8;	///< devices initialized in parallel
+	inline uint32_t DEFAULT_TRAP_THREADS		= 4;	///< threads receiving traps
 
 }	// namespace snmpfs
@@ -5,24 +5,78 @@
 #include "snmpfs.h"
 #include "snmp/devicetree.h"
 
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace snmpfs {
 
-	class DeviceInitTask : public Task
+	/**
+	 * Initialization progress of a single Device
+	 */
+	struct DeviceInitState {
+		enum Phase {
+			PENDING,
+			PROBING,
+			BACKOFF,
+			INITIALIZING,
+			READY,
+			FAILED
+		};
+
+		Device* device		= nullptr;
+		Phase phase			= PENDING;
+		uint32_t attempts	= 0;		///< number of probes so far
+		uint64_t delay		= 0;		///< current backoff in ms (without jitter)
+		uint64_t retryAt	= 0;		///< time the next probe is due while in BACKOFF
+		uint64_t probeTime	= 0;		///< duration of the last probe in ms
+		uint64_t initTime	= 0;		///< duration of initDevice in ms
+		uint64_t readyTime	= 0;		///< ms from the start of the DeviceInitTask until READY
+		bool promoted		= false;	///< requested by a filesystem access before it was queued
+	};
+
+	/**
+	 * Initializes all Devices, each Device advances through the phases of its DeviceInitState.
+	 * Due Devices are processed by at most concurrency threads, offline Devices are retried with jittered exponential backoff.
+	 * Runs on a thread of its own until every Device is READY or FAILED, so it never occupies a worker of the TaskManager.
+	 */
+	class DeviceInitTask
 	{
 	public:
-		DeviceInitTask(snmpFS* snmpfs, std::vector<DeviceConfig> deviceConfigs);
+		DeviceInitTask(snmpFS* snmpfs, std::vector<DeviceConfig> deviceConfigs, uint32_t concurrency);
+		~DeviceInitTask();
+
+		void start();
+		void stop();
+
+		DeviceInitState::Phase awaitDevice(const std::string& name);
+		bool hasDevice(const std::string& name) const { return stateIndex.contains(name); }
+		bool isPending(const std::string& name);
+		bool isDone();
 
 	private:
 		snmpFS* snmpfs;
 		std::vector<DeviceConfig> deviceConfigs;
-		tqueue<Device> deviceQueue;
+		uint32_t concurrency;
+		uint64_t started = 0;
+		std::mutex stateMutex;
+		std::condition_variable stateChanged;
+		size_t remaining = 0;			///< Devices neither READY nor FAILED
+		std::vector<DeviceInitState> states;
+		std::unordered_map<std::string, size_t> stateIndex;	///< position in states by Device name
+		tqueue<DeviceInitState> deviceQueue;
+		std::thread thread;
 		std::vector<std::thread> threads;
 
 		uint64_t calcDelay(uint64_t delay) const;
+		uint64_t jitter(uint64_t delay) const;
+		void cancel();
 		void run();
 		void runSingle();
+		void advance(DeviceInitState& state);
+		void setPhase(DeviceInitState& state, DeviceInitState::Phase phase);
+		void publishStates();
 		void initDevice(Device* device);
 	};
 
@@ -22,10 +22,14 @@ namespace snmpfs {
 
 
 		void addChild(FileNode* node);
+		bool removeChild(FileNode* node);
 		void freeChilds();
-		FileNode* getChildByName(std::string name) const;
 		std::string printFileTree() const;
 
+		// Directories may create their children lazily on lookup
+		virtual FileNode* getChildByName(std::string name);
+		virtual std::vector<std::string> getChildNames() const;
+
 		// CALLS FOR ACCESSING DATA
 		virtual int open(bool trunc);
 		virtual int read(char* buf, size_t size, off_t offset);
@@ -34,6 +38,9 @@ namespace snmpfs {
 		virtual int release();
 		virtual int truncate(off_t size);
 
+		// Files may serve each open handle from a copy of their content taken on open
+		virtual bool snapshot(std::string& data);
+
 		// CALLS FOR ATTRIBUTES
 		virtual uint64_t getMode() const;
 		virtual uint64_t getLinkCount() const;
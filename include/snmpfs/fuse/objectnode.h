@@ -31,7 +31,7 @@ namespace snmpfs {
 		virtual timespec getTimeModification() const;
 		virtual timespec getTimeStatusChange() const;
 
-
+		Object* getObject() const { return object; }
 
 	private:
 		Object* object;
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "core/graveyard.h"
+#include "fuse/filenode.h"
+#include "snmp/table.h"
+
+#include <unordered_map>
+
+namespace snmpfs {
+
+	/**
+	 * Directory view of a Table containing the full CSV as 'data',
+	 * the directory 'columns' with one file per column,
+	 * the directory 'rows' with one directory per row and one file per cell and
+	 * the directory 'where' answering queries of the form <column>=<value>.
+	 * Row, cell and query nodes are only created when they are looked up,
+	 * nodes of removed rows and every query node are handed to the Graveyard.
+	 */
+	class TableNode : public FileNode
+	{
+	public:
+		TableNode(std::string name, Table* table, Graveyard* graveyard);
+		~TableNode();
+
+	private:
+		Table* table;
+	};
+
+	class TableRowNode;
+
+	/**
+	 * Lists all rows of a Table, row directories are named by their index (e.g. 1 or 192.168.0.1)
+	 */
+	class TableRowsNode : public FileNode
+	{
+	public:
+		TableRowsNode(std::string name, Table* table, const FileNode* timeSource, Graveyard* graveyard);
+
+		FileNode* getChildByName(std::string name);
+		std::vector<std::string> getChildNames() const;
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		const FileNode* timeSource;
+		Graveyard* graveyard;
+		std::unordered_map<std::string, TableRowNode*> rowNodes;	///< rows looked up so far
+		uint32_t pruned = 0;			///< generation of the Table when rows were last pruned
+
+		void pruneRows();
+	};
+
+	/**
+	 * Single row of a Table, holds one file per column
+	 */
+	class TableRowNode : public FileNode
+	{
+	public:
+		TableRowNode(std::string name, Table* table, const TableIndex& index, const FileNode* timeSource);
+
+		FileNode* getChildByName(std::string name);
+		std::vector<std::string> getChildNames() const;
+		const TableIndex& getIndex() const { return index; }
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		TableIndex index;
+		const FileNode* timeSource;
+	};
+
+	/**
+	 * Resolves names of the form <column>=<value> to files containing the matching rows.
+	 * Query nodes are not kept, each one only lives until the call that looked it up returns.
+	 */
+	class TableWhereNode : public FileNode
+	{
+	public:
+		TableWhereNode(std::string name, Table* table, const FileNode* timeSource, Graveyard* graveyard);
+
+		FileNode* getChildByName(std::string name);
+		std::vector<std::string> getChildNames() const;
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		const FileNode* timeSource;
+		Graveyard* graveyard;
+	};
+
+	/**
+	 * Header and all rows of a Table whose cell in column equals value
+	 */
+	class TableQueryNode : public FileNode
+	{
+	public:
+		TableQueryNode(std::string name, Table* table, const std::string& column, const std::string& value, const FileNode* timeSource);
+
+		int open(bool trunc);
+		int read(char* buf, size_t size, off_t offset);
+		int write(const char* buf, size_t size, off_t offset);
+		bool snapshot(std::string& data);
+
+		uint64_t getMode() const;
+		uint64_t getSize() const;
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		std::string column;
+		std::string value;
+		const FileNode* timeSource;
+	};
+
+	/**
+	 * Single column of a Table, reads the row indices with the values of this column.
+	 * Every open handle reads the column as it was when opened.
+	 */
+	class TableColumnNode : public FileNode
+	{
+	public:
+		TableColumnNode(std::string name, Table* table, const FileNode* timeSource);
+
+		int open(bool trunc);
+		int read(char* buf, size_t size, off_t offset);
+		int write(const char* buf, size_t size, off_t offset);
+		bool snapshot(std::string& data);
+
+		uint64_t getMode() const;
+		uint64_t getSize() const;
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		const FileNode* timeSource;
+	};
+
+	/**
+	 * Single cell of a Table, reads only the value of this cell
+	 */
+	class TableCellNode : public FileNode
+	{
+	public:
+		TableCellNode(std::string name, Table* table, const TableIndex& index, const FileNode* timeSource);
+
+		int open(bool trunc);
+		int read(char* buf, size_t size, off_t offset);
+		int write(const char* buf, size_t size, off_t offset);
+
+		uint64_t getMode() const;
+		uint64_t getSize() const;
+
+		timespec getTimeAccess() const;
+		timespec getTimeModification() const;
+		timespec getTimeStatusChange() const;
+
+	private:
+		Table* table;
+		TableIndex index;
+		const FileNode* timeSource;
+	};
+
+}	// namespace snmpfs
@@ -90,6 +90,13 @@ namespace snmpfs {
 			fireChanged();
 		}
 
+		void add(uint64_t amount)
+		{
+			std::unique_lock<std::recursive_mutex> lock(mutex);
+			value += amount;
+			fireChanged();
+		}
+
 
 		std::string toString() const
 		{
@@ -172,6 +179,25 @@ namespace snmpfs {
 
 		// SNMP Timestamps
 		ProcTimestamp snmpLastRequest;
+
+		// DEVICE Initialization
+		ProcString deviceInit;				///< phase and timings of every device as CSV
+
+		// TRAP Counters
+		ProcCounter trapThreads;
+		ProcCounter trapReceived;			///< traps and informs received, published about once per second
+		ProcCounter trapRejected;			///< traps a handler did not accept
+
+		// CONFIG Reload
+		ProcString configReload;			///< outcome of the last reload as CSV
+
+		// TASK Counters
+		ProcCounter taskWorkers;
+		ProcCounter taskQueueLength;		///< due Tasks waiting for a worker
+		ProcCounter taskWaitTime;			///< ms the last started Task waited for a worker
+		ProcCounter taskWaitMax;			///< longest wait for a worker in ms
+		ProcCounter taskSteals;				///< Tasks executed by another worker than their affinity
+		ProcCounter taskSchedulerLag;		///< average ms between deadline and dispatch of a Task
 	};
 
 	class FileNode;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "config.h"
+#include "core/taskmanager.h"
+#include "fuse/virtualfile.h"
+#include "snmpfs.h"
+
+#include <atomic>
+#include <semaphore.h>
+#include <thread>
+
+namespace snmpfs {
+
+	class Object;
+
+	/**
+	 * Applies changes of the configuration file without remounting.
+	 * The file is parsed again and compared with the running configuration, only Devices and Objects that changed are touched.
+	 * Removed nodes, Objects and Devices might still be used by running filesystem calls and Tasks, so they are handed to the Graveyard.
+	 * Between reloads the graveyard is collected and finished DeviceInitTasks are dropped regularly.
+	 */
+	class ConfigReloader
+	{
+	public:
+		ConfigReloader(snmpFS* snmpfs, const snmpfsConfig& config);
+		~ConfigReloader();
+
+		void request();
+		void stop();
+		bool reload();
+
+		static void signal(int signal);
+
+	private:
+		snmpFS* snmpfs;
+		snmpfsConfig config;				///< configuration currently applied
+		sem_t requests;
+		std::atomic<bool> running;
+		std::thread thread;
+
+		void run();
+		void reapInitTasks();
+		bool isPending(const std::string& name);
+		Device* findDevice(const std::string& name);
+		void addDevices(const std::vector<DeviceConfig>& devices, uint32_t concurrency);
+		void removeDevice(const std::string& name);
+		bool updateDevice(Device* device, const DeviceConfig& current, DeviceConfig& next);
+	};
+
+	/**
+	 * Control file, every write requests a reload of the configuration
+	 */
+	class ReloadNode : public VirtualFile
+	{
+	public:
+		ReloadNode(std::string name, ConfigReloader* reloader);
+
+		int write(const char* buf, size_t size, off_t offset);
+		uint64_t getMode() const;
+
+	private:
+		ConfigReloader* reloader;
+	};
+
+}	// namespace snmpfs
@@ -33,6 +33,8 @@ namespace snmpfs {
 
 	void test_tqueue();
 
+	void test_config_benchmark(size_t devices = 10000);
+
 	class SandboxObject
 	{
 	public:
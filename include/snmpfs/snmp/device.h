@@ -46,6 +46,8 @@ namespace snmpfs {
 
 		bool initSNMP();
 		void cleanupSNMP();
+		void* openSession() const;
+		void closeSession(void* handle) const;
 
 		// LOGGING API
 		void logInfo	(const std::string& msg) const;
@@ -58,24 +60,30 @@ namespace snmpfs {
 		Object* lookupObject(ObjectID oid, uint32_t interval) const;
 		void registerObject(Object* obj, uint32_t interval);
 		void unregisterObject(Object* obj);
+		void stopUpdates();
 
 		// SNMP API
 		bool formatVariable(netsnmp_variable_list* var, std::string& data) const;
 		bool probe(ObjectID oid) const;
 		bool next(ObjectID& oid) const;
 		bool next(ObjectID& oid, ObjectData& data) const;
+		bool next(ObjectID& oid, ObjectData& data, void* handle) const;
 		ObjectData get(const ObjectID& id) const;
+		std::vector<ObjectData> get(const std::vector<ObjectID>& ids) const;
 		ObjectData set(ObjectID oid, char type, std::string data) const;
+		std::vector<ObjectData> set(const std::vector<ObjectData>& objects, bool partial = false) const;
 		std::vector<ObjectData> walk() const;
 		std::vector<ObjectData> walkSubtree(const ObjectID& oid) const;
+		std::vector<ObjectData> walkSubtree(const ObjectID& oid, void* handle) const;
 
 		// bool active() const { return counterRequests == counterTimeouts; }
 		Status checkStatus() const;
 		void update();
 
+		snmpFS* getFS() const { return snmpfs; }
 		const DeviceConfig& getConfig() const { return config; }
 		std::string getName() const { return name; }
-		const std::map<uint32_t, UpdateTask> getTasks() const { return tasks; }
+		const std::map<uint32_t, UpdateTask> getTasks() const { std::unique_lock<std::mutex> lock(tasksMutex); return tasks; }
 
 	private:
 		// ESSENTIAL INFO
@@ -88,8 +96,11 @@ namespace snmpfs {
 		void* snmpHandle;
 
 		// TASKS CONTAINING ALL OBJECTS
+		mutable std::mutex tasksMutex;
 		std::map<uint32_t, UpdateTask> tasks;
-		bool updateObjects(const std::map<ObjectID, Object*>& objects);
+		bool stopped = false;			///< removed from the filesystem, Tasks are no longer scheduled
+		bool updateObjects(const std::map<ObjectID, Object*>& objects, uint64_t parkTime = 0);
+		void regroupObjects(UpdateTask& task);
 
 		// SNMP API
 		bool checkStatus(int status, const std::string& op);
@@ -97,6 +108,7 @@ namespace snmpfs {
 		std::vector<ObjectData> processResponse(netsnmp_pdu* response) const;
 		bool processTrap(netsnmp_pdu* response);
 		bool sendPDU(netsnmp_pdu* pdu, netsnmp_pdu** response, const std::string& op) const;
+		bool sendPDU(void* handle, netsnmp_pdu* pdu, netsnmp_pdu** response, const std::string& op) const;
 
 		friend class UpdateTask;
 		friend class DeviceTrapHandler;
@@ -110,6 +122,7 @@ namespace snmpfs {
 	public:
 		UpdateTask();
 		size_t getSize() const { return objects.size(); }
+		size_t getAffinity() const;
 	private:
 		void run();
 		Device* device;
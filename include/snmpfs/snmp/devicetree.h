@@ -18,6 +18,7 @@ namespace snmpfs {
 
 	public:
 		static DeviceTree* fromConfig(Device* device);
+		static DeviceTree* fromConfig(Device* device, const std::vector<ObjectConfig>& objects);
 		static DeviceTree* fromDevice(Device* device);
 
 
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "snmp_ext.h"
+
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace snmpfs {
+
+	/**
+	 * Single node of the MIB tree, children of a node are stored next to each other sorted by subid
+	 */
+	struct MIBNode {
+		uint32_t subid;
+		uint32_t parent;		///< index of the parent node, MIBIndex::NONE for roots
+		uint32_t firstChild;
+		uint32_t childCount;
+		uint32_t label;			///< offset into the string pool
+		uint32_t enums;			///< index of the first enum
+		uint32_t enumCount;
+		uint8_t type;			///< TYPE_* of net-snmp
+		uint8_t access;			///< MIB_ACCESS_* of net-snmp
+		uint8_t known;			///< defined by a module net-snmp could find
+		uint8_t reserved;
+	};
+
+	struct MIBEnum {
+		int32_t value;
+		uint32_t label;
+	};
+
+	/**
+	 * Flat copy of the MIB tree of net-snmp that can be written to a file and mapped back into memory.
+	 * Loading the mapped file avoids parsing all MIB files on every start,
+	 * the fingerprint of the MIB files decides whether a cached index is still valid.
+	 */
+	class MIBIndex
+	{
+	public:
+		static constexpr uint32_t NONE = UINT32_MAX;
+
+		MIBIndex();
+		~MIBIndex();
+
+		MIBIndex(const MIBIndex&) = delete;
+		MIBIndex& operator=(const MIBIndex&) = delete;
+
+		bool build(tree* head, uint64_t fingerprint);
+		bool load(const std::filesystem::path& path, uint64_t fingerprint);
+		bool save(const std::filesystem::path& path) const;
+		void clear();
+
+		bool empty() const { return nodeCount == 0; }
+		size_t size() const { return nodeCount; }
+
+		const MIBNode* find(const oid* name, size_t length) const;
+		const MIBNode* findClosest(const oid* name, size_t length) const;
+		const MIBNode* findLabel(const std::string& label) const;
+		bool parse(const std::string& raw, std::vector<oid>& oids) const;
+		int resolveValue(const oid* name, size_t length, char& type, std::string& data) const;
+
+		const MIBNode* getParent(const MIBNode* node) const;
+		const MIBNode* getChildren(const MIBNode* node) const;
+		const MIBNode* getChild(const MIBNode* node, uint32_t subid) const;
+		const char* getLabel(const MIBNode* node) const;
+		const char* getEnumLabel(const MIBNode* node, int32_t value) const;
+		bool getEnumValue(const MIBNode* node, const std::string& label, int32_t& value) const;
+		std::vector<oid> getOID(const MIBNode* node) const;
+
+		void setTreeLoader(std::function<bool()> loader);
+		bool requireTree();
+
+		static uint64_t fingerprint(const std::vector<std::filesystem::path>& files, bool system, const std::vector<std::string>& selection = {});
+
+		/**
+		 * Index used by ObjectID, it is set up once while initializing SNMP and only read afterwards
+		 */
+		static MIBIndex& global();
+
+	private:
+		// Either the mapped cache file or the owned buffer of a built index
+		const uint8_t* data	= nullptr;
+		size_t dataSize		= 0;
+		bool mapped			= false;
+		std::vector<uint8_t> buffer;
+
+		const MIBNode* nodes	= nullptr;
+		const MIBEnum* enums	= nullptr;
+		const char* strings		= nullptr;
+		uint32_t nodeCount		= 0;
+		uint32_t enumCount		= 0;
+		uint32_t stringSize		= 0;
+		uint32_t rootCount		= 0;
+
+		// Labels are only hashed when symbolic OIDs have to be resolved
+		mutable std::mutex labelMutex;
+		mutable std::unordered_map<std::string, uint32_t> labels;
+
+		// Loads the MIBs into net-snmp if the index was taken from the cache (see requireTree)
+		std::mutex treeMutex;
+		std::function<bool()> treeLoader;
+
+		bool attach(const uint8_t* data, size_t size, uint64_t fingerprint);
+		const MIBNode* search(uint32_t first, uint32_t count, uint32_t subid) const;
+	};
+
+}	// namespace snmpfs
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "snmp_ext.h"
+
+#include <filesystem>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace snmpfs {
+
+	/**
+	 * Loads only the MIB modules needed for a set of OIDs instead of every available MIB file.
+	 * Files are scanned for their module name, IMPORTS and the OID assignments they define,
+	 * modules defining a required OID are loaded together with all modules they import.
+	 */
+	class MIBLoader
+	{
+	public:
+		bool scan(const std::filesystem::path& path);
+		void scanSystem();
+
+		bool require(const std::string& raw);
+		bool load() const;
+
+		size_t getModuleCount() const { return modules.size(); }
+		size_t getRequiredCount() const { return required.size(); }
+
+	private:
+		struct Module {
+			std::string name;
+			std::filesystem::path file;
+			std::vector<std::string> imports;
+			bool system;					///< found in the MIB directories of net-snmp
+		};
+
+		struct Definition {
+			std::string parent;				///< label the value is relative to, empty if absolute
+			std::vector<uint32_t> subids;
+			uint32_t module;
+		};
+
+		std::vector<Module> modules;
+		std::unordered_map<std::string, uint32_t> moduleIndex;
+		std::unordered_map<std::string, std::vector<Definition>> definitions;
+
+		// Resolved lazily on the first require
+		std::unordered_map<std::string, std::vector<uint32_t>> resolved;
+		std::map<std::vector<uint32_t>, std::vector<uint32_t>> owners;	///< OID -> modules defining it
+		bool indexed = false;
+
+		std::set<uint32_t> required;
+
+		void scanPath(const std::filesystem::path& path, bool system);
+		void scanFile(const std::filesystem::path& file, bool system);
+		bool resolve(const std::string& label, std::vector<uint32_t>& oids, uint32_t depth);
+		void index();
+		void requireModule(uint32_t module);
+	};
+
+}	// namespace snmpfs
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "objectid.h"
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -67,9 +69,28 @@ namespace snmpfs {
 		void handleError(const ObjectData& response);
 		virtual std::string getData() const;									///> GET data represented as string
 		virtual bool update();													///> UPDATE data from snmp GET
+		bool refresh();															///> UPDATE, concurrent callers share a single request
+		virtual bool isStale() const;											///> data is older than the configured max age
+		uint64_t getMaxAge() const;
+		void setMaxAge(uint64_t maxAge);
+
+		// ADAPTIVE POLLING
+		uint32_t getInterval() const;											///> current polling interval in seconds
+		uint32_t getBaseInterval() const;										///> configured polling interval in seconds
+		void setInterval(uint32_t interval);
+		void setIntervalBounds(uint32_t minInterval, uint32_t maxInterval);
+		bool isAdaptive() const;
+		uint32_t adapt();														///> Halves the interval if the data changed since the last call, doubles it otherwise
 		virtual bool updateData(const std::string& data);						///> UPDATE data on Device
 		virtual bool updateData(const ObjectID& oid, const std::string& data);	///> UPDATE data from string (does not update remote data)
 
+		// ACCESS TRACKING
+		virtual void touch();													///> Called when a consumer reads the data
+		uint64_t getLastRead() const;
+		bool park(uint64_t idleTime);											///> Parks the object if it was not read for idleTime ms
+		bool wake();															///> Unparks the object, returns true if it was parked
+		bool isParked() const;
+
 		// OBSERVER RELATED
 		void registerObserver(ObjectObserver* observer);
 		void unregisterObserver(ObjectObserver* observer);
@@ -82,6 +103,25 @@ namespace snmpfs {
 		ObjectID id;
 		char type;
 		std::string data;
+		std::atomic<uint64_t> lastRead = 0;
+		std::atomic<bool> parked = false;		///< not polled until the next read
+		std::atomic<uint64_t> lastUpdate = 0;	///< time of the last successful refresh
+		std::atomic<uint64_t> maxAge = 0;		///< ms after which a read refreshes the data (0 = never)
+
+		// ADAPTIVE POLLING
+		uint32_t baseInterval = 0;
+		std::atomic<uint32_t> interval = 0;
+		uint32_t minInterval = 0;
+		uint32_t maxInterval = 0;
+		mutable std::atomic<uint64_t> changeCount = 0;	///< incremented by every change of the data
+		uint64_t adaptedChangeCount = 0;		///< changeCount seen by the last adapt
+
+		// SINGLEFLIGHT
+		std::mutex refreshMutex;
+		std::condition_variable refreshDone;
+		bool refreshing			= false;
+		bool refreshResult		= false;
+		uint64_t refreshCount	= 0;
 
 		mutable std::mutex observerMutex;
 		std::vector<ObjectObserver*> observers;
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "snmp/mibindex.h"
 #include "snmp_ext.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -42,9 +44,11 @@ namespace snmpfs {
 		ObjectID getSubOID(uint64_t subID) const;
 		bool isAncestorOf(const ObjectID& descendantOID) const;
 		bool isParentOf(const ObjectID& childOID) const;
+		size_t commonLength(const ObjectID& other) const;
+		ObjectID getPrefix(size_t length) const;
 
-		static tree* toMIB(const ObjectID& id);
-		tree* getMIB() const { return mib; }
+		static const MIBNode* toMIB(const ObjectID& id);
+		const MIBNode* getMIB() const { return mib; }
 		bool hasMIB() const { return mibAvailable; }
 
 		bool isReadable() const { return readable; }
@@ -56,7 +60,7 @@ namespace snmpfs {
 
 		std::vector<oid> oids;
 
-		tree* mib;
+		const MIBNode* mib	= nullptr;
 		bool mibAvailable	= false;
 		bool readable		= true;
 		bool writable		= true;
@@ -70,4 +74,39 @@ namespace snmpfs {
 		void updateInfo();
 	};
 
+	/**
+	 * Returns the entry stored under id, if there is none the entries stored under ancestors of id (e.g. the Table of a cell).
+	 * Only steps back to entries sharing a prefix with id, so unrelated OIDs sorting in between are skipped.
+	 */
+	template<typename T>
+	std::vector<T> findOwners(const std::map<ObjectID, T>& entries, const ObjectID& id)
+	{
+		std::vector<T> owners;
+		auto it = entries.upper_bound(id);
+		if(it == entries.begin()) return owners;
+
+		it--;
+		if(it->first == id)
+		{
+			owners.push_back(it->second);
+			return owners;
+		}
+
+		while(true)
+		{
+			// Remaining ancestors are not longer than the prefix shared with this entry
+			size_t common = it->first.commonLength(id);
+			if(common == it->first.length())
+				owners.push_back(it->second);
+			else if(common == 0)
+				break;
+			else
+				it = entries.upper_bound(id.getPrefix(common));
+
+			if(it == entries.begin()) break;
+			it--;
+		}
+		return owners;
+	}
+
 }	// namespace snmpfs
@@ -14,6 +14,8 @@ namespace snmpfs {
 
 	std::string snmp_error_code_name(long int code);
 	char snmp_type2char(u_char type);
+	char snmp_mibtype2char(u_char type);
+	void snmp_use_mib_index();
 	void snmp_syslog_err(snmp_session* session);
 
 }	// namespace snmpfs
@@ -7,15 +7,51 @@
 
 namespace snmpfs {
 
+	/**
+	 * Index of a table row, the arcs following the column OID of a cell
+	 */
+	using TableIndex = std::vector<oid>;
+
+	/**
+	 * Location of a value inside one of the arenas of a Table
+	 */
+	struct TableSpan {
+		uint32_t offset	= 0;
+		uint32_t length	= 0;
+	};
+
+	/**
+	 * Holds the values of a single column contiguously, indexed by row position.
+	 * As long as every value of the column is an integer they are stored as such,
+	 * otherwise the column switches to spans into the string arena of the Table.
+	 */
 	class TableColumn
 	{
 	public:
 		std::string name;
 		ObjectID oid;
+		char type		= '=';				///< SNMP type of the cells (used for SET)
+		bool numeric	= true;				///< cells are stored in numbers instead of strings
+
+		std::vector<uint8_t> present;		///< row has a value in this column
+		std::vector<int64_t> numbers;		///< NUMERIC ONLY
+		std::vector<TableSpan> strings;		///< STRING ONLY
+
+		uint64_t lastRead		= 0;		///< last time a consumer read this column
+		bool resumed			= false;	///< read again after update skipped it, has to be walked before serving
+		bool dense				= false;	///< had a cell in every row when last walked, so it can track the rows alone
+		mutable std::string cache;			///< rendered projection of this column (see Table::getColumnData)
+		mutable bool cacheValid	= false;
+
+		// Secondary index, only built once the column is queried (see Table::getMatchingRows)
+		mutable bool indexed	= false;
+		mutable std::map<std::string, std::set<TableIndex>> valueIndex;
 	};
 
 	/**
-	* @todo write docs
+	* Table represents a SNMP table with all its cells.
+	* Cells are stored column wise, rows are kept in a vector sorted by their numeric index
+	* whose positions index all columns. Row indices are stored once in the index arena.
 	*/
 	class Table : public Object
 	{
@@ -44,17 +80,77 @@ namespace snmpfs {
 
 		bool dump() const;
 
+		// SINGLE ROW/CELL/COLUMN ACCESS (used by TableNode)
+		std::string getColumnData(const std::string& column) const;
+		size_t getColumnSize(const std::string& column) const;
+		std::string getMatchingRows(const std::string& column, const std::string& value) const;
+		size_t getMatchingSize(const std::string& column, const std::string& value) const;
+		std::vector<std::string> getColumnNames() const;
+		std::vector<TableIndex> getRowIndices() const;
+		bool hasRow(const TableIndex& index) const;
+		uint32_t getGeneration() const;
+		bool getCellData(const TableIndex& index, const std::string& column, std::string& data) const;
+
+		// ACCESS TRACKING
+		void touch();
+		void touchColumn(const std::string& column);
+		void setSkipUnread(uint64_t idleTime);
+		bool isStale() const;
+
+		static bool parseIndex(const std::string& raw, TableIndex& index);
+		static std::string formatIndex(const TableIndex& index);
+
 	private:
 		char colSeparator	= ',';
 		char rowSeparator	= '\n';
 
-		// mutable std::mutex tableLock;
+		mutable std::mutex tableMutex;
 		std::vector<TableColumn> columns;
-		std::map<ObjectID, std::map<std::string, Object*>> cells;
+		std::vector<TableSpan> rows;		///< sorted row indices (spans into indexArena), position is the index into the columns
+		std::vector<oid> indexArena;		///< arcs of all row indices
+		size_t indexGarbage = 0;			///< arcs in indexArena no longer referenced
+		std::vector<uint32_t> rowGeneration;	///< last update in which the row was seen
+		uint32_t generation = 0;			///< incremented by every update
+		std::string arena;					///< values of all string columns
+		size_t arenaGarbage = 0;			///< bytes in arena no longer referenced
+
+		// RENDERED CSV CACHE (rebuilt lazily by getData)
+		mutable std::string csvCache;				///< header and all rows as returned by getData
+		mutable std::vector<TableSpan> rowSpans;	///< location of each row inside csvCache
+		mutable std::vector<uint8_t> rowDirty;		///< row has to be rendered again
+		mutable bool anyRowDirty	= false;
+		mutable bool layoutValid	= false;		///< false if rows were added/removed since rendering
+
+		uint64_t skipUnread = 0;			///< columns not read for this many ms are not polled (0 = poll all)
+
+		size_t findColumn(const std::string& name) const;
+		void resume(TableColumn& column);
+		void invalidateColumns();
+		size_t findRow(const oid* index, size_t length) const;
+		size_t findRow(const oid* index, size_t length, size_t hint) const;
+		size_t insertRow(const oid* index, size_t length);
+		bool sweepRows();
+		TableIndex getRowIndex(size_t row) const;
+		ObjectID getCellOID(size_t column, const TableIndex& index) const;
+
+		void appendCell(std::string& out, size_t column, size_t row) const;
+		void appendRow(std::string& out, size_t row) const;
+		void render() const;
+		void renderAll() const;
+		void renderDirtyRows() const;
+		void renderColumn(size_t c) const;
+		void buildValueIndex(size_t column) const;
+		std::string getCell(size_t column, size_t row) const;
+		bool setCell(size_t column, size_t row, const std::string& data);
+		void handleCellError(size_t column, const ObjectData& response);
+		void updateValueIndex(size_t column, size_t row, const std::string& data);
+		void removeFromValueIndex(size_t column, size_t row, const TableIndex& index);
+
+		void convertToStrings(TableColumn& column);
+		void compactArena();
 
-		std::set<std::string> getRowIDs() const;
-		void removeRow(std::string rowID);
-		static std::string makeRowID(const ObjectID& columnID, const ObjectID& cellID);
+		static bool parseNumber(const std::string& data, int64_t& number);
+		static bool lessIndex(const oid* a, size_t aLength, const oid* b, size_t bLength);
 	};
 
 }	// namespace snmpfs
@@ -63,7 +63,7 @@ namespace snmpfs {
 		/**
 		* Default constructor
 		*/
-		DeviceTrapHandler(const std::vector<Device*>& devices);
+		DeviceTrapHandler(snmpFS* snmpfs);
 
 		/**
 		* Destructor
@@ -76,7 +76,7 @@ namespace snmpfs {
 		static Device* findTrapDevice(const std::vector<Device*>& devices, const TrapData& trap);
 
 	private:
-		const std::vector<Device*>& devices;
+		snmpFS* snmpfs;
 	};
 
 	/**
@@ -89,7 +89,7 @@ namespace snmpfs {
 		/**
 		* Default constructor
 		*/
-		LogTrapHandler(const std::vector<Device*>& devices);
+		LogTrapHandler(snmpFS* snmpfs);
 
 		/**
 		* Destructor
@@ -100,7 +100,7 @@ namespace snmpfs {
 		bool handle(const TrapData& trap);
 
 	private:
-		const std::vector<Device*>& devices;
+		snmpFS* snmpfs;
 	};
 
 }	// namespace snmpfs
@@ -1,36 +1,62 @@
 #pragma once
 
+#include "proc.h"
 #include "traphandler.h"
 #include "snmp/snmp_ext.h"
 
-#include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <vector>
 
 namespace snmpfs {
 
 	/**
-	* @todo write docs
-	*/
+	 * Receives traps on a UDP port with one or more threads.
+	 * Every thread owns a socket bound with SO_REUSEPORT, so the kernel spreads incoming traps between them,
+	 * and its own net-snmp session, so traps are decoded and dispatched without a shared lock.
+	 */
 	class AbstractTrapReceiver
 	{
 	public:
 		/**
 		* Default constructor
 		*/
-		AbstractTrapReceiver(uint16_t port);
+		AbstractTrapReceiver(uint16_t port, uint32_t threads = 1, ProcData* proc = nullptr);
 
 		/**
 		* Destructor
 		*/
 		virtual ~AbstractTrapReceiver();
 
+		bool start();
+		void stop();
+
 		uint16_t getPort() const;
+		size_t getThreadCount() const { return listeners.size(); }
+
+	protected:
+		/**
+		 * Socket, session and counters of a single receiver thread, passed as callback_magic to the session
+		 */
+		struct Listener {
+			AbstractTrapReceiver* receiver;
+			netsnmp_transport* transport;
+			void* handle;				///< single session of net-snmp
+			std::thread thread;
+
+			// Only touched by the thread itself, added to the proc counters periodically
+			uint64_t received	= 0;
+			uint64_t rejected	= 0;
+			uint64_t published	= 0;
+		};
 
 	private:
 		uint16_t port;
-		netsnmp_session* session;
+		uint32_t threads;
+		ProcData* proc;
+		int stopEvent = -1;				///< eventfd waking all threads on stop
+		std::vector<Listener*> listeners;
 
 		/*
 		* Callbacks needed to receive traps
@@ -40,14 +66,14 @@ namespace snmpfs {
 		virtual int post_parse(netsnmp_session* session, netsnmp_pdu* pdu, int unknown) = 0;
 		virtual int process(int op, netsnmp_session* session, int reqid, netsnmp_pdu* pdu, void* magic) = 0;
 
+		std::vector<netsnmp_transport*> openTransports();
+		void listen(Listener* listener);
+		void publish(Listener* listener, bool force);
 
-		// static functions to register a AbstractTrapReceiver since one static function is needed
-		static void registerReceiver(netsnmp_session* session, AbstractTrapReceiver* receiver);
-		static void unregisterReceiver(netsnmp_session* session);
+		// static functions forwarding to the AbstractTrapReceiver of the Listener in callback_magic
 		static int receiverPreParse(netsnmp_session * session, netsnmp_transport *transport, void *transport_data, int transport_data_length);
 		static int receiverPostParse(netsnmp_session* session, netsnmp_pdu* pdu, int unknown);
 		static int receiverProcess(int op, netsnmp_session* session, int reqid, netsnmp_pdu* pdu, void* magic);
-		static void receiverLoop();
 	};
 
 	class TrapReceiver : public AbstractTrapReceiver
@@ -56,7 +82,7 @@ namespace snmpfs {
 		/**
 		* Default constructor
 		*/
-		TrapReceiver(uint16_t port);
+		TrapReceiver(uint16_t port, uint32_t threads = 1, ProcData* proc = nullptr);
 
 		/**
 		* Destructor
@@ -68,7 +94,7 @@ namespace snmpfs {
 		void removeHandler(AbstractTrapHandler* handler);
 
 	private:
-		std::mutex handlerMutex;
+		std::shared_mutex handlerMutex;
 		std::vector<AbstractTrapHandler*> handlers;
 
 		int pre_parse(netsnmp_session * session, netsnmp_transport *transport, void *transport_data, int transport_data_length);
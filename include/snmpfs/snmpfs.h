@@ -1,8 +1,12 @@
 #pragma once
 
+#include "core/graveyard.h"
 #include "proc.h"
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace snmpfs {
 
@@ -21,13 +25,40 @@ namespace snmpfs {
 		SNMPFS_OPT_KEY_VERSION
 	};
 
+	class ConfigReloader;
 	class Device;
+	class DeviceInitTask;
 	class FileNode;
 	class TaskManager;
 	class VirtualLogger;
 	class TrapReceiver;
 	struct snmpfsConfig;
 
+	/**
+	 * Copy of the Device list for threads that must not wait for the filesystem (e.g. trap receivers).
+	 * Replaced as a whole on every change, readers keep the list they got as long as they need it.
+	 */
+	class DeviceSnapshot
+	{
+	public:
+		std::shared_ptr<const std::vector<Device*>> get() const
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			return devices;
+		}
+
+		void set(const std::vector<Device*>& devices)
+		{
+			std::shared_ptr<const std::vector<Device*>> copy = std::make_shared<const std::vector<Device*>>(devices);
+			std::unique_lock<std::mutex> lock(mutex);
+			this->devices = copy;
+		}
+
+	private:
+		mutable std::mutex mutex;
+		std::shared_ptr<const std::vector<Device*>> devices = std::make_shared<const std::vector<Device*>>();
+	};
+
 	/**
 	 * Holds the filesystem data after initialization
 	 */
@@ -35,12 +66,16 @@ namespace snmpfs {
 		std::mutex mutex;
 		bool active = false;
 		std::vector<Device*> devices;
+		DeviceSnapshot deviceSnapshot;	///< copy of devices, updated together while holding mutex
 		FileNode* root = NULL;
 
 		// Proc Data
 		ProcData proc;
 		TaskManager taskManager;
+		Graveyard graveyard{&taskManager};	///< nodes, Objects and Devices removed while still in use
+		std::vector<DeviceInitTask*> initTasks;	///< one for mounting and one per reload adding Devices
 		TrapReceiver* trapReceiver = NULL;
+		ConfigReloader* reloader = NULL;
 	};
 
 	snmpFS* createFS(const snmpfsConfig& config);
@@ -2,7 +2,7 @@
 
 #include "core/util.h"
 #include "defines.h"
-#include <set>
+#include <algorithm>
 
 namespace snmpfs {
 
@@ -21,8 +21,14 @@ namespace snmpfs {
 		std::stringstream ss;
 
 		ss << "Config File: " << config.configPath << std::endl;
+		ss << "Workers: " << config.workers << std::endl;
+		ss << "Init Concurrency: " << config.initConcurrency << std::endl;
+		ss << "Trap Port: " << config.trap.port << std::endl;
+		ss << "Trap Threads: " << config.trap.threads << std::endl;
 
 		ss << "MIBS (loadSystemMIBs = " << config.loadSystemMIBs <<"):" << std::endl;
+		ss << "Selective MIBs: " << config.selectiveMIBs << std::endl;
+		ss << "MIB Cache: " << config.mibCache << std::endl;
 		for(const std::filesystem::path& mib : config.mibs)
 			ss << mib << std::endl;
 
@@ -39,12 +45,17 @@ namespace snmpfs {
 				ss << "\t\t" << "Name:			"	<< object.name			<< std::endl;
 				ss << "\t\t" << "OID:			"	<< object.rawOID		<< std::endl;
 				ss << "\t\t" << "Interval:		"	<< object.interval		<< std::endl;
+				ss << "\t\t" << "MaxAge:			"	<< object.maxAge		<< std::endl;
+				ss << "\t\t" << "MinInterval:	"	<< object.minInterval	<< std::endl;
+				ss << "\t\t" << "MaxInterval:	"	<< object.maxInterval	<< std::endl;
 				ss << "\t\t" << "Type:			"	<< object.type			<< std::endl;
 				ss << "\t\t" << "Placeholder:	"	<< object.placeholder	<< std::endl;
 				ss << "\t\t" << "Prefix:	"		<< object.placeholder	<< std::endl;
 
 				if(object.type == TABLE)
 				{
+					ss << "\t\t" << "Directory:	"	<< object.directory		<< std::endl;
+					ss << "\t\t" << "SkipUnread:	"	<< object.skipUnread	<< std::endl;
 					ss << "\t\t" << "Columns: " << object.type << std::endl;
 					for(const ConfigEntry& column : object.columns)
 					{
@@ -77,6 +88,8 @@ namespace snmpfs {
 					ss << "\t" << "Priv:\t" << device.auth.privAlgorithm << "\t" << device.auth.privPassphrase << std::endl;
 			}
 			ss << "\t" << "Interval:\t" << device.interval << std::endl;
+			ss << "\t" << "Walkers:\t" << device.walkConcurrency << std::endl;
+			ss << "\t" << "ParkAfter:\t" << device.parkAfter << std::endl;
 
 			for(const ObjectConfig& object : device.objects)
 			{
@@ -85,11 +98,16 @@ namespace snmpfs {
 				ss << "\t\t" << "Name:    \t"	<< object.name			<< std::endl;
 				ss << "\t\t" << "OID:     \t"	<< object.rawOID		<< std::endl;
 				ss << "\t\t" << "Interval:\t"	<< object.interval		<< std::endl;
+				ss << "\t\t" << "MaxAge:  \t"	<< object.maxAge		<< std::endl;
+				ss << "\t\t" << "MinInterval:\t"	<< object.minInterval	<< std::endl;
+				ss << "\t\t" << "MaxInterval:\t"	<< object.maxInterval	<< std::endl;
 				ss << "\t\t" << "Type:    \t"	<< object.type			<< std::endl;
 				ss << "\t\t" << "Prefix:	"	<< object.placeholder	<< std::endl;
 
 				if(object.type == TABLE)
 				{
+					ss << "\t\t" << "Directory:\t"	<< object.directory	<< std::endl;
+					ss << "\t\t" << "SkipUnread:\t"	<< object.skipUnread	<< std::endl;
 					ss << "\t\t" << "Columns: " << object.type << std::endl;
 					for(const ConfigEntry& column : object.columns)
 					{
@@ -112,6 +130,10 @@ namespace snmpfs {
 		// INIT CONFIG
 		config.configPath	= configPath;
 		config.interval		= DEFAULT_INTERVAL;	// TODO Move somewhere else ?
+		config.parkAfter	= DEFAULT_PARK_AFTER;
+		config.workers		= DEFAULT_WORKERS;
+		config.initConcurrency	= DEFAULT_INIT_CONCURRENCY;
+		config.trap.threads	= DEFAULT_TRAP_THREADS;
 
 		// Load XML
 		tinyxml2::XMLDocument doc;
@@ -159,17 +181,68 @@ namespace snmpfs {
 			}
 		}
 
+		// Check parkAfter
+		const tinyxml2::XMLAttribute* parkAfterAttribute	= rootNode->FindAttribute("parkAfter");
+		if(parkAfterAttribute)
+		{
+			unsigned parkAfter;
+			if(parkAfterAttribute->QueryUnsignedValue(&parkAfter) == tinyxml2::XML_SUCCESS)
+			{
+				config.parkAfter = parkAfter;
+			}
+			else
+			{
+				printf("'snmpfs' element has invalid value for attribute 'parkAfter'\n");
+				return false;
+			}
+		}
+
+		// Check workers
+		const tinyxml2::XMLAttribute* workersAttribute	= rootNode->FindAttribute("workers");
+		if(workersAttribute)
+		{
+			unsigned workers;
+			if(workersAttribute->QueryUnsignedValue(&workers) == tinyxml2::XML_SUCCESS && workers > 0)
+			{
+				config.workers = workers;
+			}
+			else
+			{
+				printf("'snmpfs' element has invalid value for attribute 'workers'\n");
+				return false;
+			}
+		}
+
+		// Check initConcurrency
+		const tinyxml2::XMLAttribute* initConcurrencyAttribute	= rootNode->FindAttribute("initConcurrency");
+		if(initConcurrencyAttribute)
+		{
+			unsigned initConcurrency;
+			if(initConcurrencyAttribute->QueryUnsignedValue(&initConcurrency) == tinyxml2::XML_SUCCESS && initConcurrency > 0)
+			{
+				config.initConcurrency = initConcurrency;
+			}
+			else
+			{
+				printf("'snmpfs' element has invalid value for attribute 'initConcurrency'\n");
+				return false;
+			}
+		}
+
 
 		// Check device
+		std::unordered_set<std::string> deviceNames;
 		tinyxml2::XMLElement* deviceElement = rootNode->FirstChildElement("device");
 		while(deviceElement != nullptr)
 		{
 			DeviceConfig deviceConfig = {};
 			deviceConfig.interval = config.interval;
+			deviceConfig.walkConcurrency = DEFAULT_WALK_CONCURRENCY;
+			deviceConfig.parkAfter = config.parkAfter;
 			bool valid = true;
 			valid &= readDevice(deviceElement, deviceConfig);
-			valid &= checkName(config, deviceConfig);
-			if(valid) config.devices.push_back(deviceConfig);
+			valid &= checkName(deviceNames, deviceConfig.name, "Device");
+			if(valid) config.devices.push_back(std::move(deviceConfig));
 			else return false;
 
 			deviceElement = deviceElement->NextSiblingElement("device");
@@ -195,16 +268,27 @@ namespace snmpfs {
 				config.loadSystemMIBs = false;
 			}
 
+			const tinyxml2::XMLAttribute* selectiveAttribute	= mibsElement->FindAttribute("selective");
+			config.selectiveMIBs = selectiveAttribute ? selectiveAttribute->BoolValue() : false;
+
+			const tinyxml2::XMLAttribute* cacheAttribute	= mibsElement->FindAttribute("cache");
+			if(cacheAttribute)
+			{
+				config.mibCache = cacheAttribute->Value();
+			}
+
 			bool valid = readMIBs(mibsElement, config.mibs);
 			if(!valid) return false;
 		}
 		else
 		{
 			config.loadSystemMIBs = true;
+			config.selectiveMIBs = false;
 		}
 
 
 		// Check template
+		std::unordered_set<std::string> templateNames;
 		tinyxml2::XMLElement* templateElement = rootNode->FirstChildElement("template");
 		while(templateElement != nullptr)
 		{
@@ -219,8 +303,8 @@ namespace snmpfs {
 			templateConfig.interval = -1;
 			bool valid = true;
 			valid &= readTemplate(templateElement, templateConfig);
-			valid &= checkName(config, templateConfig);
-			if(valid) config.templates.push_back(templateConfig);
+			valid &= checkName(templateNames, templateConfig.name, "Template");
+			if(valid) config.templates.push_back(std::move(templateConfig));
 			else return false;
 
 			templateElement = templateElement->NextSiblingElement("template");
@@ -246,9 +330,13 @@ namespace snmpfs {
 
 
 		// Last step is to replace all placeholders with their corresponding templates
+		TemplateCache cache;
+		for(const TemplateConfig& tmplt : config.templates)
+			cache.templates[tmplt.name] = &tmplt;
+
 		for(DeviceConfig& device : config.devices)
 		{
-			bool suc = replaceTemplates(config.templates, device);
+			bool suc = replaceTemplates(cache, device);
 			if(!suc) return false;
 		}
 
@@ -336,6 +424,38 @@ namespace snmpfs {
 			}
 		}
 
+		// Check walkConcurrency
+		const tinyxml2::XMLAttribute* walkConcurrencyAttribute = deviceElement->FindAttribute("walkConcurrency");
+		if(walkConcurrencyAttribute)
+		{
+			unsigned walkConcurrency;
+			if(walkConcurrencyAttribute->QueryUnsignedValue(&walkConcurrency) == tinyxml2::XML_SUCCESS && walkConcurrency > 0)
+			{
+				config.walkConcurrency = walkConcurrency;
+			}
+			else
+			{
+				printf("'device' element has invalid value for attribute 'walkConcurrency'\n");
+				return false;
+			}
+		}
+
+		// Check parkAfter
+		const tinyxml2::XMLAttribute* parkAfterAttribute = deviceElement->FindAttribute("parkAfter");
+		if(parkAfterAttribute)
+		{
+			unsigned parkAfter;
+			if(parkAfterAttribute->QueryUnsignedValue(&parkAfter) == tinyxml2::XML_SUCCESS)
+			{
+				config.parkAfter = parkAfter;
+			}
+			else
+			{
+				printf("'device' element has invalid value for attribute 'parkAfter'\n");
+				return false;
+			}
+		}
+
 		// Check snmp
 		if(deviceElement->ChildElementCount("snmp") > 1)
 		{
@@ -360,7 +480,7 @@ namespace snmpfs {
 		tinyxml2::XMLElement* objectsElement = deviceElement->FirstChildElement("objects");
 		if(objectsElement)
 		{
-			bool valid = readObjects(objectsElement, config.objects);
+			bool valid = readObjects(objectsElement, config.objects.edit());
 			if(!valid)
 			{
 				printf("Error occured when reading objects of device '%s'\n", config.name.c_str());
@@ -569,6 +689,7 @@ namespace snmpfs {
 	bool ConfigIO::readObjects(tinyxml2::XMLElement* objectsElement, std::vector<ObjectConfig>& objects)
 	{
 		// Check for object elements
+		std::unordered_set<std::string> names;
 		tinyxml2::XMLElement* objectElement = objectsElement->FirstChildElement();
 		while(objectElement != nullptr)
 		{
@@ -577,8 +698,8 @@ namespace snmpfs {
 			objectConfig.interval = -1;	// In order to replace them later if not specified by XML
 			bool valid = true;
 			valid &= readObject(objectElement, objectConfig);
-			valid &= checkName(objects, objectConfig);
-			if(valid) objects.push_back(objectConfig);
+			valid &= checkName(names, objectConfig.name, "Object");
+			if(valid) objects.push_back(std::move(objectConfig));
 			else return false;
 
 			objectElement = objectElement->NextSiblingElement();
@@ -668,6 +789,57 @@ namespace snmpfs {
 			}
 		}
 
+		const tinyxml2::XMLAttribute* maxAgeAttribute	= objectElement->FindAttribute("maxAge");
+		if(maxAgeAttribute)
+		{
+			unsigned maxAge;
+			if(maxAgeAttribute->QueryUnsignedValue(&maxAge) == tinyxml2::XML_SUCCESS)
+			{
+				config.maxAge = maxAge;
+			}
+			else
+			{
+				printf("'%s' element has invalid value for attribute 'maxAge'\n", elementName.c_str());
+				return false;
+			}
+		}
+
+		const tinyxml2::XMLAttribute* minIntervalAttribute	= objectElement->FindAttribute("minInterval");
+		if(minIntervalAttribute)
+		{
+			unsigned minInterval;
+			if(minIntervalAttribute->QueryUnsignedValue(&minInterval) == tinyxml2::XML_SUCCESS && minInterval > 0)
+			{
+				config.minInterval = minInterval;
+			}
+			else
+			{
+				printf("'%s' element has invalid value for attribute 'minInterval'\n", elementName.c_str());
+				return false;
+			}
+		}
+
+		const tinyxml2::XMLAttribute* maxIntervalAttribute	= objectElement->FindAttribute("maxInterval");
+		if(maxIntervalAttribute)
+		{
+			unsigned maxInterval;
+			if(maxIntervalAttribute->QueryUnsignedValue(&maxInterval) == tinyxml2::XML_SUCCESS && maxInterval > 0)
+			{
+				config.maxInterval = maxInterval;
+			}
+			else
+			{
+				printf("'%s' element has invalid value for attribute 'maxInterval'\n", elementName.c_str());
+				return false;
+			}
+		}
+
+		if(config.minInterval && config.maxInterval && config.minInterval > config.maxInterval)
+		{
+			printf("'%s' element has 'minInterval' greater than 'maxInterval'\n", elementName.c_str());
+			return false;
+		}
+
 		const tinyxml2::XMLAttribute* placeholderAttribute	= objectElement->FindAttribute("placeholder");
 		if(placeholderAttribute)
 		{
@@ -684,6 +856,38 @@ namespace snmpfs {
 		}
 
 
+		const tinyxml2::XMLAttribute* directoryAttribute	= objectElement->FindAttribute("directory");
+		if(directoryAttribute)
+		{
+			bool directory;
+			if(directoryAttribute->QueryBoolValue(&directory) == tinyxml2::XML_SUCCESS)
+			{
+				config.directory = directory;
+			}
+			else
+			{
+				printf("'%s' element has invalid value for attribute 'directory'\n", elementName.c_str());
+				return false;
+			}
+		}
+
+
+		const tinyxml2::XMLAttribute* skipUnreadAttribute	= objectElement->FindAttribute("skipUnread");
+		if(skipUnreadAttribute)
+		{
+			bool skipUnread;
+			if(skipUnreadAttribute->QueryBoolValue(&skipUnread) == tinyxml2::XML_SUCCESS)
+			{
+				config.skipUnread = skipUnread;
+			}
+			else
+			{
+				printf("'%s' element has invalid value for attribute 'skipUnread'\n", elementName.c_str());
+				return false;
+			}
+		}
+
+
 		// Check prefix
 		const tinyxml2::XMLAttribute* prefixAttribute = objectElement->FindAttribute("prefix");
 		if(prefixAttribute)
@@ -770,70 +974,46 @@ namespace snmpfs {
 		}
 		config.port	= portAttribute->IntValue();
 
+		const tinyxml2::XMLAttribute* threadsAttribute	= trapElement->FindAttribute("threads");
+		if(threadsAttribute)
+		{
+			unsigned threads;
+			if(threadsAttribute->QueryUnsignedValue(&threads) == tinyxml2::XML_SUCCESS && threads > 0)
+			{
+				config.threads = threads;
+			}
+			else
+			{
+				printf("'trap' element has invalid value for attribute 'threads'\n");
+				return false;
+			}
+		}
+
 		// TODO other stuff concerning TrapHandlers
 
 		return true;
 	}
 
 
-	bool ConfigIO::replaceTemplates(const std::vector<TemplateConfig>& templates, DeviceConfig& device)
+	/**
+	 * Replaces reuse placeholders, devices with the same interval and objects get the same ObjectList
+	 */
+	bool ConfigIO::replaceTemplates(TemplateCache& cache, DeviceConfig& device)
 	{
-		// while loop to allow nested templates
-		bool foundReuse = true;
-		size_t levels = 0;
-		while(foundReuse && levels < 32)
+		TemplateCache::DeviceKey key(device.interval, device.objects.get());
+		auto it = cache.devices.find(key);
+		if(it != cache.devices.end())
 		{
-			foundReuse = false;
-			levels++;
-
-			for(size_t i = 0; i < device.objects.size(); i++)
-			{
-				const ObjectConfig& placeholder = device.objects[i];
-				if(placeholder.type != REUSE) continue;
-				foundReuse = true;
-				int32_t interval	= placeholder.interval;
-				bool prefix			= placeholder.prefix;
-
-				// Search template
-				const TemplateConfig* tmplt = nullptr;
-				for(const TemplateConfig& search : templates)
-				{
-					if(search.name == placeholder.name)
-					{
-						tmplt = &search;
-						break;
-					}
-				}
-
-				if(!tmplt)
-				{
-					printf("template '%s' was not found\n", placeholder.name.c_str());
-					return false;
-				}
-
-				// Remove template object
-				device.objects.erase(device.objects.begin() + i);
-
-				// Add objects from template
-				for(size_t t = 0; t < tmplt->objects.size(); t++)
-				{
-					ObjectConfig copy = tmplt->objects[t];
-					if(interval != -1)
-					{
-						copy.interval = interval;
-					}
-					if(prefix)
-					{
-						copy.name = tmplt->name + "_" + copy.name;
-					}
-					device.objects.insert(device.objects.begin() + i + t, copy);
-				}
-			}
+			device.objects = it->second;
+			return true;
 		}
 
+		std::vector<ObjectConfig> objects;
+		if(!appendObjects(cache, device.objects.get(), objects))
+			return false;
 
 		// Set unset interval values with device interval
-		for(ObjectConfig& obj : device.objects)
+		for(ObjectConfig& obj : objects)
 		{
 			if(obj.interval == -1)
 			{
@@ -841,69 +1021,111 @@ namespace snmpfs {
 			}
 		}
 
+		device.objects = ObjectList(std::move(objects));
+		cache.devices.emplace(std::move(key), device.objects);
 		return true;
 	}
 
+	size_t ConfigIO::TemplateCache::DeviceKeyHash::operator()(const DeviceKey& key) const
+	{
+		size_t hash = std::hash<int32_t>()(key.first);
+		for(const ObjectConfig& obj : key.second)
+			hash = hash * 31 + (std::hash<std::string>()(obj.name) ^ std::hash<std::string>()(obj.rawOID));
+		return hash;
+	}
 
+	/**
+	 * Returns the objects of the template with nested templates replaced, expanding it on first use
+	 */
+	const std::vector<ObjectConfig>* ConfigIO::expandTemplate(TemplateCache& cache, const std::string& name)
+	{
+		auto it = cache.expanded.find(name);
+		if(it != cache.expanded.end())
+			return &it->second;
 
+		auto tmplt = cache.templates.find(name);
+		if(tmplt == cache.templates.end())
+		{
+			printf("template '%s' was not found\n", name.c_str());
+			return nullptr;
+		}
 
-	bool ConfigIO::checkDuplicates(const DeviceConfig& device)
-	{
-		std::set<std::string> names;
-		for(const ObjectConfig& obj : device.objects)
+		if(!cache.expanding.insert(name).second)
 		{
-			if(names.contains(obj.name))
-			{
-				printf("Device '%s' has duplicated object '%s'! Please check device and templates used!\n", device.name.c_str(), obj.name.c_str());
-				return false;
-			}
-			names.insert(obj.name);
+			printf("template '%s' reuses itself\n", name.c_str());
+			return nullptr;
 		}
-		return true;
-	}
 
+		std::vector<ObjectConfig> objects;
+		bool suc = appendObjects(cache, tmplt->second->objects, objects);
+		cache.expanding.erase(name);
+		if(!suc) return nullptr;
 
-	bool snmpfs::ConfigIO::checkName(const std::vector<snmpfs::ObjectConfig>& objects, const ObjectConfig& object)
-{
-		for(const ObjectConfig& obj : objects)
+		return &(cache.expanded[name] = std::move(objects));
+	}
+
+	/**
+	 * Appends objects to expanded, reuse placeholders are replaced by the objects of their template
+	 */
+	bool ConfigIO::appendObjects(TemplateCache& cache, const std::vector<ObjectConfig>& objects, std::vector<ObjectConfig>& expanded)
+	{
+		for(const ObjectConfig& placeholder : objects)
 		{
-			if(obj.name == object.name)
+			if(placeholder.type != REUSE)
 			{
-				printf("Object with name '%s' already exists!\n", object.name.c_str());
+				expanded.push_back(placeholder);
+				continue;
+			}
+
+			const std::vector<ObjectConfig>* tmpltObjects = expandTemplate(cache, placeholder.name);
+			if(!tmpltObjects)
 				return false;
+
+			// Add objects from template
+			expanded.reserve(expanded.size() + tmpltObjects->size());
+			for(const ObjectConfig& obj : *tmpltObjects)
+			{
+				ObjectConfig& copy = expanded.emplace_back(obj);
+				if(placeholder.interval != -1)
+				{
+					copy.interval = placeholder.interval;
+				}
+				if(placeholder.prefix)
+				{
+					copy.name = placeholder.name + "_" + copy.name;
+				}
 			}
 		}
 		return true;
 	}
 
-	bool ConfigIO::checkName(const snmpfsConfig& snmpfsConfig, const DeviceConfig& device)
+
+
+
+	bool ConfigIO::checkDuplicates(const DeviceConfig& device)
 	{
-		for(const DeviceConfig& dev : snmpfsConfig.devices)
+		std::unordered_set<std::string> names;
+		names.reserve(device.objects.size());
+		for(const ObjectConfig& obj : device.objects)
 		{
-			if(dev.name == device.name)
+			if(!names.insert(obj.name).second)
 			{
-				printf("Device with name '%s' already exists!\n", device.name.c_str());
+				printf("Device '%s' has duplicated object '%s'! Please check device and templates used!\n", device.name.c_str(), obj.name.c_str());
 				return false;
 			}
 		}
 		return true;
 	}
 
-	bool ConfigIO::checkName(const snmpfsConfig& snmpfsConfig, const TemplateConfig& tmpt)
+
+	bool ConfigIO::checkName(std::unordered_set<std::string>& names, const std::string& name, const char* kind)
 	{
-		for(const TemplateConfig& tmp : snmpfsConfig.templates)
+		if(!names.insert(name).second)
 		{
-			if(tmp.name == tmpt.name)
-			{
-				printf("Template with name '%s' already exists!\n", tmpt.name.c_str());
-				return false;
-			}
+			printf("%s with name '%s' already exists!\n", kind, name.c_str());
+			return false;
 		}
 		return true;
 	}
 
-
-
-
-
 }	// namespace snmpfs
@@ -0,0 +1,99 @@
+#include "core/graveyard.h"
+
+#include "core/taskmanager.h"
+#include <vector>
+
+namespace snmpfs {
+
+	Graveyard::Graveyard(TaskManager* taskManager) : taskManager(taskManager)
+	{
+
+	}
+
+	Graveyard::~Graveyard()
+	{
+		clear();
+	}
+
+	uint64_t Graveyard::enter()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		visitors[epoch]++;
+		return epoch;
+	}
+
+	void Graveyard::leave(uint64_t epoch)
+	{
+		bool pending;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto it = visitors.find(epoch);
+			if(--it->second == 0) visitors.erase(it);
+			pending = !graves.empty();
+		}
+
+		if(pending) collect();
+	}
+
+	/**
+	 * Takes over freeing something no longer reachable for calls entering from now on
+	 */
+	void Graveyard::bury(std::function<void()> free, bool usedByTasks)
+	{
+		uint64_t checkpoint = usedByTasks && taskManager ? taskManager->checkpoint() : 0;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		graves.push_back({epoch, usedByTasks, checkpoint, std::move(free)});
+		epoch++;
+	}
+
+	/**
+	 * Frees every entry no call inside can reference anymore, returns how many were freed
+	 */
+	size_t Graveyard::collect()
+	{
+		std::vector<std::function<void()>> dead;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			uint64_t oldest = visitors.empty() ? UINT64_MAX : visitors.begin()->first;
+
+			// Entries are freed in the order they were buried (e.g. nodes before the Objects they observe)
+			while(!graves.empty() && graves.front().epoch < oldest)
+			{
+				const Grave& grave = graves.front();
+				if(grave.usedByTasks && taskManager && !taskManager->hasPassed(grave.checkpoint))
+					break;
+
+				dead.push_back(std::move(graves.front().free));
+				graves.pop_front();
+			}
+		}
+
+		// Freeing might take locks of its own
+		for(std::function<void()>& free : dead)
+			free();
+		return dead.size();
+	}
+
+	/**
+	 * Frees everything regardless of calls inside, only used on shutdown
+	 */
+	void Graveyard::clear()
+	{
+		std::deque<Grave> dead;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			dead.swap(graves);
+		}
+
+		for(Grave& grave : dead)
+			grave.free();
+	}
+
+	size_t Graveyard::size() const
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return graves.size();
+	}
+
+}	// namespace snmpfs
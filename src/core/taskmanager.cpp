@@ -1,5 +1,8 @@
 #include "core/taskmanager.h"
 
+#include "proc.h"
+#include <algorithm>
+
 namespace snmpfs {
 
 	Task::Task(Type type) : type(type)
@@ -37,6 +40,17 @@ namespace snmpfs {
 		return lastUpdate;
 	}
 
+	size_t Task::getAffinity() const
+	{
+		// Pointers are aligned, the lower bits carry no information
+		return reinterpret_cast<uintptr_t>(this) >> 4;
+	}
+
+	void Task::cancel()
+	{
+
+	}
+
 	void Task::execute()
 	{
 		run();
@@ -63,18 +77,27 @@ namespace snmpfs {
 			delete task;
 		}
 		tasks.clear();
+		deadlines.clear();
 	}
 
 	void TaskManager::addTask(Task* task)
 	{
 		std::unique_lock<std::mutex> lock(taskMutex);
-		tasks.insert(task);
+		if(!tasks.insert(task).second) return;
+		if(task->status == Task::WAITING) schedule(task);
 	}
 
 	void TaskManager::removeTask(Task* task)
 	{
 		std::unique_lock<std::mutex> lock(taskMutex);
-		tasks.erase(task);
+		if(!tasks.erase(task)) return;
+		deadlines.erase({task->deadline, task});
+		for(Worker& worker : workers)
+		{
+			auto it = std::remove(worker.queue.begin(), worker.queue.end(), task);
+			queued -= worker.queue.end() - it;
+			worker.queue.erase(it, worker.queue.end());
+		}
 	}
 
 	const std::set<Task*> TaskManager::getTasks() const
@@ -92,62 +115,268 @@ namespace snmpfs {
 	bool TaskManager::isIdle() const
 	{
 		std::unique_lock<std::mutex> lock(taskMutex);
-		for(const Task* task : tasks)
+		if(queued > 0) return false;
+		for(const Worker& worker : workers)
 		{
-			if(task->status == Task::RUNNING)
+			if(worker.busy)
 				return false;
 		}
 		return true;
 	}
 
+	/**
+	 * Marks the executions running right now, see hasPassed
+	 */
+	uint64_t TaskManager::checkpoint() const
+	{
+		std::unique_lock<std::mutex> lock(taskMutex);
+		return executions;
+	}
+
+	/**
+	 * Returns true once every execution running at the checkpoint has returned,
+	 * afterwards no Task removed before the checkpoint is touched anymore
+	 */
+	bool TaskManager::hasPassed(uint64_t checkpoint) const
+	{
+		std::unique_lock<std::mutex> lock(taskMutex);
+		for(const Worker& worker : workers)
+		{
+			if(worker.busy && worker.execution <= checkpoint)
+				return false;
+		}
+		return true;
+	}
 
 
-	void TaskManager::start()
+
+	void TaskManager::start(size_t workers, ProcData* proc)
 	{
-		if(running)
-			throw std::runtime_error("TaskManager already running!");
-		running	= true;
-		thread	= std::thread(&TaskManager::run, this);
+		{
+			std::unique_lock<std::mutex> lock(taskMutex);
+			if(running)
+				throw std::runtime_error("TaskManager already running!");
+			if(workers == 0)
+				throw std::runtime_error("TaskManager needs at least one worker!");
+			running			= true;
+			this->proc		= proc;
+			this->workers	= std::vector<Worker>(workers);
+			thread			= std::thread(&TaskManager::run, this);
+			for(size_t i = 0; i < workers; i++)
+				this->workers[i].thread = std::thread(&TaskManager::work, this, i);
+		}
+
+		if(proc) proc->taskWorkers.set(workers);
 	}
 
 	void TaskManager::stop()
 	{
+		std::unique_lock<std::mutex> lock(taskMutex);
 		if(!running)
 			throw std::runtime_error("TaskManager not running!");
 		running	= false;
+
+		// Tasks not picked up by a worker are not executed anymore
+		for(Worker& worker : workers)
+		{
+			if(worker.current)
+				worker.current->cancel();
+			for(Task* task : worker.queue)
+				task->status = Task::WAITING;
+			worker.queue.clear();
+			worker.condition.notify_all();
+		}
+		queued = 0;
+
+		taskCondition.notify_all();
 	}
 
 	void TaskManager::join()
 	{
 		thread.join();
-		// TODO Don't know if this solution is best... DeviceInitTask blocks very long...
-		while(!isIdle())
+		// Workers only return after finishing their current Task
+		for(Worker& worker : workers)
+			worker.thread.join();
+		workers.clear();
+	}
+
+
+	/**
+	 * Inserts the Task according to its next deadline, taskMutex has to be held.
+	 * RECURRENT Tasks run on a wall clock aligned grid shifted by a phase derived from their affinity and interval,
+	 * so Tasks sharing an interval are spread across it instead of firing at once.
+	 */
+	void TaskManager::schedule(Task* task)
+	{
+		uint64_t period = 1000 * (uint64_t) task->interval;
+		if(period == 0)
+		{
+			task->deadline = task->lastUpdate;
+		}
+		else
+		{
+			uint64_t phase	= (task->getAffinity() ^ (task->interval * 0x9E3779B97F4A7C15ull)) % period;
+			uint64_t from	= task->lastUpdate ? task->lastUpdate : now();
+
+			// First slot of the grid after the last execution, missed slots are skipped
+			uint64_t next = from - from % period + phase;
+			if(next <= from) next += period;
+			task->deadline = next;
+		}
+		auto it = deadlines.emplace(task->deadline, task).first;
+
+		// Scheduler might sleep until a later deadline
+		if(it == deadlines.begin())
+			taskCondition.notify_all();
+	}
+
+	/**
+	 * Hands a due Task to the worker of its affinity, taskMutex has to be held
+	 */
+	void TaskManager::dispatch(Task* task)
+	{
+		Worker& owner = workers[task->getAffinity() % workers.size()];
+		owner.queue.push_back(task);
+		queued++;
+
+		if(!owner.busy)
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			owner.condition.notify_one();
+			return;
+		}
+
+		// Owner is busy, wake one idle worker to steal the Task
+		for(Worker& worker : workers)
+		{
+			if(!worker.busy && !worker.woken)
+			{
+				worker.woken = true;
+				worker.condition.notify_one();
+				break;
+			}
 		}
 	}
 
+	/**
+	 * Checks if a busy worker has Tasks waiting, taskMutex has to be held
+	 */
+	bool TaskManager::canSteal(size_t worker) const
+	{
+		for(size_t i = 0; i < workers.size(); i++)
+		{
+			if(i != worker && workers[i].busy && !workers[i].queue.empty())
+				return true;
+		}
+		return false;
+	}
 
 	void TaskManager::run()
 	{
+		std::unique_lock<std::mutex> lock(taskMutex);
 		while(running)
 		{
-			taskMutex.lock();
-			for(Task* task : tasks)
+			if(deadlines.empty())
+			{
+				taskCondition.wait(lock);
+				continue;
+			}
+
+			uint64_t current = now();
+			uint64_t next = deadlines.begin()->first;
+			if(next > current)
 			{
-				if(task->status != Task::WAITING)
-					continue;
+				taskCondition.wait_for(lock, std::chrono::milliseconds(next - current));
+				continue;
+			}
+
+			// Only due Tasks are touched
+			while(!deadlines.empty() && deadlines.begin()->first <= current)
+			{
+				Task* task = deadlines.begin()->second;
+				deadlines.erase(deadlines.begin());
 
-				uint64_t nextUpdate = task->lastUpdate + 1000 * task->interval;
-				if(nextUpdate <= now())
+				task->status	= Task::RUNNING;
+				task->enqueued	= current;
+				dispatch(task);
+
+				// Exponential moving average of how late Tasks are dispatched
+				schedulerLag += ((double) (current - task->deadline) - schedulerLag) / 8;
+			}
+
+			if(proc)
+			{
+				size_t length	= queued;
+				uint64_t lag	= schedulerLag;
+				lock.unlock();
+				proc->taskQueueLength.set(length);
+				proc->taskSchedulerLag.set(lag);
+				lock.lock();
+			}
+		}
+	}
+
+	void TaskManager::work(size_t worker)
+	{
+		std::unique_lock<std::mutex> lock(taskMutex);
+		Worker& self = workers[worker];
+		while(true)
+		{
+			// Workers woken to steal might find nothing left if the owner was faster, they have to be woken again next time
+			while(running && self.queue.empty() && !canSteal(worker))
+			{
+				self.woken = false;
+				self.condition.wait(lock);
+			}
+			self.woken = false;
+			if(!running) break;
+
+			// Own Tasks are taken from the front, stolen ones from the back of the fullest queue
+			Task* task = nullptr;
+			bool stolen = self.queue.empty();
+			if(!stolen)
+			{
+				task = self.queue.front();
+				self.queue.pop_front();
+			}
+			else
+			{
+				Worker* victim = nullptr;
+				for(size_t i = 0; i < workers.size(); i++)
 				{
-					task->status = Task::RUNNING;
-					// use detached thread instead of std::async to avoid blocking destructor of future
-					std::thread(&Task::execute, task).detach();
+					if(i == worker || !workers[i].busy || workers[i].queue.empty()) continue;
+					if(!victim || workers[i].queue.size() > victim->queue.size())
+						victim = &workers[i];
 				}
+				task = victim->queue.back();
+				victim->queue.pop_back();
 			}
-			taskMutex.unlock();
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			queued--;
+			size_t length	= queued;
+			uint64_t wait	= now() - task->enqueued;
+			self.busy		= true;
+			self.current	= task;
+			self.execution	= ++executions;
+			lock.unlock();
+
+			if(proc)
+			{
+				proc->taskQueueLength.set(length);
+				proc->taskWaitTime.set(wait);
+				if(wait > proc->taskWaitMax.get())
+					proc->taskWaitMax.set(wait);
+				if(stolen)
+					proc->taskSteals.inc();
+			}
+
+			task->execute();
+
+			lock.lock();
+			self.busy		= false;
+			self.current	= nullptr;
+
+			// RECURRENT Tasks are scheduled again, unless they were removed in the meantime
+			if(tasks.contains(task) && task->status == Task::WAITING)
+				schedule(task);
 		}
 	}
 
@@ -45,7 +45,7 @@ namespace snmpfs {
 		config.interval	= 5;
 		config.rawOID	= oid;
 		config.type		= type;
-		device.objects.push_back(config);
+		device.objects.edit().push_back(config);
 	}
 
 	void Demo::addObjects(DeviceConfig& device)
@@ -71,7 +71,7 @@ namespace snmpfs {
 		table.columns.push_back({"desc", "iso.3.6.1.2.1.25.2.3.1.3"});
 		table.columns.push_back({"size", "iso.3.6.1.2.1.25.2.3.1.5"});
 		table.columns.push_back({"used", "iso.3.6.1.2.1.25.2.3.1.6"});
-		device.objects.push_back(table);
+		device.objects.edit().push_back(table);
 
 		// 	add(device, "storageFull",	"iso.3.6.1.2.1.25.2.3",			TABLE);		// TABLE
 	}
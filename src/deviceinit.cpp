@@ -1,15 +1,102 @@
 #include "deviceinit.h"
 
+#include "fuse/tablenode.h"
+#include "snmp/mibindex.h"
 #include "snmp/table.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <random>
 
 namespace snmpfs {
 
-	DeviceInitTask::DeviceInitTask(snmpFS* snmpfs, std::vector<DeviceConfig> deviceConfigs) : Task(SINGLE), snmpfs(snmpfs), deviceConfigs(deviceConfigs)
+	DeviceInitTask::DeviceInitTask(snmpFS* snmpfs, std::vector<DeviceConfig> deviceConfigs, uint32_t concurrency) : snmpfs(snmpfs), deviceConfigs(deviceConfigs), concurrency(concurrency)
 	{
+		// States exist before the Task runs, so accesses right after mounting can already be served
+		states.resize(this->deviceConfigs.size());
+		remaining = states.size();
+		for(size_t i = 0; i < this->deviceConfigs.size(); i++)
+			stateIndex[this->deviceConfigs[i].name] = i;
+	}
+
+	DeviceInitTask::~DeviceInitTask()
+	{
+		stop();
+	}
+
+	void DeviceInitTask::start()
+	{
+		thread = std::thread(&DeviceInitTask::run, this);
+	}
+
+	/**
+	 * Stops probing and waits until the running initializations are done
+	 */
+	void DeviceInitTask::stop()
+	{
+		if(!thread.joinable()) return;
+
+		cancel();
+		thread.join();
+	}
+
+	/**
+	 * Blocks until the Device was probed, Devices waiting for their first probe or whose backoff expired are moved ahead of all others.
+	 * Devices still backing off are not probed early, otherwise every access would skip the backoff and wait for a timeout.
+	 * Returns the phase of the Device afterwards, FAILED if it is unknown.
+	 */
+	DeviceInitState::Phase DeviceInitTask::awaitDevice(const std::string& name)
+	{
+		auto it = stateIndex.find(name);
+		if(it == stateIndex.end())
+			return DeviceInitState::FAILED;
+		DeviceInitState& state = states[it->second];
+
+		std::unique_lock<std::mutex> lock(stateMutex);
+		switch(state.phase)
+		{
+			case DeviceInitState::READY:
+			case DeviceInitState::FAILED:
+				return state.phase;
+
+			case DeviceInitState::BACKOFF:
+				if(state.retryAt > TaskManager::now())
+					return state.phase;
+				[[fallthrough]];
+
+			case DeviceInitState::PENDING:
+				if(!deviceQueue.promote(&state))
+					state.promoted = true;
+				break;
+
+			// Already being probed
+			default:
+				break;
+		}
+
+		uint32_t attempts = state.attempts;
+		stateChanged.wait(lock, [&]()
+		{
+			return state.phase == DeviceInitState::READY
+				|| state.phase == DeviceInitState::FAILED
+				|| (state.phase == DeviceInitState::BACKOFF && state.attempts > attempts)
+				|| deviceQueue.isClosed();
+		});
+		return state.phase;
+	}
 
+	/**
+	 * Returns true if the Device is neither READY nor FAILED yet
+	 */
+	bool DeviceInitTask::isPending(const std::string& name)
+	{
+		auto it = stateIndex.find(name);
+		if(it == stateIndex.end())
+			return false;
+
+		std::unique_lock<std::mutex> lock(stateMutex);
+		DeviceInitState::Phase phase = states[it->second].phase;
+		return phase != DeviceInitState::READY && phase != DeviceInitState::FAILED;
 	}
 
 
@@ -23,19 +110,45 @@ namespace snmpfs {
 		return 2 * delay;
 	}
 
+	/**
+	 * Picks a delay between half and the full backoff, so Devices going offline together do not retry together
+	 */
+	uint64_t DeviceInitTask::jitter(uint64_t delay) const
+	{
+		thread_local std::minstd_rand random(std::random_device{}());
+		std::uniform_int_distribution<uint64_t> distribution(delay / 2, delay);
+		return distribution(random);
+	}
+
+	void DeviceInitTask::cancel()
+	{
+		// Wakes all threads waiting for the next device or for a device to become ready
+		deviceQueue.close();
+		std::unique_lock<std::mutex> lock(stateMutex);
+		stateChanged.notify_all();
+	}
+
 	void DeviceInitTask::run()
 	{
+		started = TaskManager::now();
+
 		// CREATE ALL DEVICES
-		for(const DeviceConfig& config : deviceConfigs)
+		if(states.empty()) deviceQueue.close();
+		for(size_t i = 0; i < deviceConfigs.size(); i++)
 		{
-			Device* device = new Device(snmpfs, config);
+			Device* device = new Device(snmpfs, deviceConfigs[i]);
 			device->initSNMP();
-			deviceQueue.push(device);
+
+			std::unique_lock<std::mutex> lock(stateMutex);
+			states[i].device = device;
+			if(states[i].promoted)	deviceQueue.pushAt(&states[i], 0);
+			else					deviceQueue.push(&states[i]);
 		}
+		publishStates();
 
 		// CREATE THREADS FOR PARALLEL INITIALIZATION
-		// TODO How many threads? One for each device?
-		for(size_t i = 0; i < 8; i++)
+		size_t threadCount = std::min<size_t>(concurrency, states.size());
+		for(size_t i = 0; i < threadCount; i++)
 			threads.emplace_back(&DeviceInitTask::runSingle, this);
 
 		// WAIT FOR ALL THREADS
@@ -45,10 +158,12 @@ namespace snmpfs {
 		// DELETE ALL DEVICES STILL IN QUEUE (during shutdown process)
 		while(true)
 		{
-			Device* device = deviceQueue.pop();
-			if(!device) break;
-			device->cleanupSNMP();
-			delete device;
+			DeviceInitState* state = deviceQueue.pop();
+			if(!state) break;
+			state->device->cleanupSNMP();
+			delete state->device;
+			state->device = nullptr;
+			setPhase(*state, DeviceInitState::FAILED);
 		}
 	}
 
@@ -62,48 +177,125 @@ namespace snmpfs {
 			snmpfs->mutex.unlock();
 			if(!active)	break;
 
-			// GET NEXT DEVICE
-			Device* device;
+			// GET NEXT DEVICE (sleeps until it is due)
+			DeviceInitState* state;
 			uint64_t delay;
-			while(deviceQueue.waiting())
+			deviceQueue.awaitNext(&state, &delay);
+
+			// STOP CONDITION 2 (all devices done or shutdown)
+			if(!state)
+				break;
+
+			advance(*state);
+		}
+	}
+
+	/**
+	 * Probes the Device and depending on the result initializes it, gives up or schedules the next attempt
+	 */
+	void DeviceInitTask::advance(DeviceInitState& state)
+	{
+		Device* device = state.device;
+
+		setPhase(state, DeviceInitState::PROBING);
+		uint64_t probeStart = TaskManager::now();
+		Device::Status status = device->checkStatus();
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			state.probeTime = TaskManager::now() - probeStart;
+			state.attempts++;
+		}
+
+		switch(status)
+		{
+			case Device::ONLINE:
 			{
-				snmpfs->mutex.lock();
-				bool active = snmpfs->active;
-				snmpfs->mutex.unlock();
-				if(!active)	break;
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				setPhase(state, DeviceInitState::INITIALIZING);
+				uint64_t initStart = TaskManager::now();
+				initDevice(device);
+				{
+					std::unique_lock<std::mutex> lock(stateMutex);
+					state.initTime	= TaskManager::now() - initStart;
+					state.readyTime	= TaskManager::now() - started;
+				}
+				setPhase(state, DeviceInitState::READY);
+				break;
 			}
-			deviceQueue.next(&device, &delay);
 
-			// STOP CONDITION 2
-			if(!device)
+			case Device::INACCESSIBLE:
+				device->logErr("Inaccessible! Please check credentials!");
+				device->cleanupSNMP();
+				delete device;
+				state.device = nullptr;
+				setPhase(state, DeviceInitState::FAILED);
+				break;
+
+			case Device::OFFLINE:
+			{
+				state.delay = calcDelay(state.delay);
+				uint64_t delay = jitter(state.delay);
+				std::stringstream ss;
+				ss << "Waiting ";
+				ss << (delay / 1000) << "s";
+				ss << " for device to become online..";
+				device->logInfo(ss.str());
+				{
+					std::unique_lock<std::mutex> lock(stateMutex);
+					state.retryAt = TaskManager::now() + delay;
+				}
+				setPhase(state, DeviceInitState::BACKOFF);
+				deviceQueue.pushIn(&state, delay);
 				break;
+			}
+		}
+	}
+
+	/**
+	 * Returns true once every Device is READY or FAILED
+	 */
+	bool DeviceInitTask::isDone()
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		return remaining == 0;
+	}
+
+	void DeviceInitTask::setPhase(DeviceInitState& state, DeviceInitState::Phase phase)
+	{
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			state.phase = phase;
+
+			// Threads waiting for due devices are released once every device is done
+			if((phase == DeviceInitState::READY || phase == DeviceInitState::FAILED) && --remaining == 0)
+				deviceQueue.close();
+			stateChanged.notify_all();
+		}
+		publishStates();
+	}
+
+	/**
+	 * Writes the state and timings of all Devices as CSV to the proc file device_init
+	 */
+	void DeviceInitTask::publishStates()
+	{
+		static const char* phaseNames[] = { "pending", "probing", "backoff", "initializing", "ready", "failed" };
 
-			// SKIP IF OFFLINE
-			Device::Status status = device->checkStatus();
-			switch(status)
+		std::stringstream ss;
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			ss << "device,phase,attempts,probe_ms,init_ms,ready_ms" << std::endl;
+			for(size_t i = 0; i < states.size(); i++)
 			{
-				case Device::ONLINE:
-					initDevice(device);
-					break;
-
-				case Device::INACCESSIBLE:
-					device->logErr("Inaccessible! Please check credentials!");
-					device->cleanupSNMP();
-					delete device; device = nullptr;
-					break;
-
-				case Device::OFFLINE:
-					delay = calcDelay(delay);
-					std::stringstream ss;
-					ss << "Waiting ";
-					ss << (delay / 1000) << "s";
-					ss << " for device to become online..";
-					device->logInfo(ss.str());
-					deviceQueue.pushIn(device, delay);
-					break;
+				const DeviceInitState& state = states[i];
+				ss << deviceConfigs[i].name << ",";
+				ss << phaseNames[state.phase] << ",";
+				ss << state.attempts << ",";
+				ss << state.probeTime << ",";
+				ss << state.initTime << ",";
+				ss << state.readyTime << std::endl;
 			}
 		}
+		snmpfs->proc.deviceInit.set(ss.str());
 	}
 
 
@@ -142,7 +334,20 @@ namespace snmpfs {
 		// ADD DEVICE TO FILESYSTEM
 		snmpfs->mutex.lock();
 		snmpfs->devices.push_back(device);
-		insertFileNodeByPath("/", deviceNode, snmpfs->root);	// TODO insert by actual path?
+		snmpfs->deviceSnapshot.set(snmpfs->devices);
+		FileNode* placeholder = snmpfs->root->getChildByName(device->getName());
+		if(placeholder)
+		{
+			// Placeholder might already be referenced by running filesystem calls, so it is filled instead of replaced
+			for(FileNode* child : deviceNode->children)
+				placeholder->addChild(child);
+			deviceNode->children.clear();
+			delete deviceNode;
+		}
+		else
+		{
+			insertFileNodeByPath("/", deviceNode, snmpfs->root);	// TODO insert by actual path?
+		}
 		snmpfs->mutex.unlock();
 
 		auto initEnd	= std::chrono::high_resolution_clock::now();
@@ -167,17 +372,19 @@ namespace snmpfs {
 		const ObjectID& oid = table->getID();
 
 		// if no columns specified, load according to MIB
-		tree* tr = oid.getMIB();
-		tree* entry = tr->child_list;
+		const MIBIndex& index = MIBIndex::global();
+		const MIBNode* tr = oid.getMIB();
+		if(tr->childCount == 0)
+			return;
 
-		if(entry)
+		// Children in the index are already ordered by subid
+		const MIBNode* entry = index.getChildren(tr);
+		const MIBNode* columns = index.getChildren(entry);
+		for(uint32_t i = 0; i < entry->childCount; i++)
 		{
-			for(tree* col = entry->child_list; col; col = col->next_peer)
-			{
-				table->addColumn(col->label, oid.getSubOID(entry->subid).getSubOID(col->subid));
-			}
+			const MIBNode* col = columns + i;
+			table->addColumn(index.getLabel(col), oid.getSubOID(entry->subid).getSubOID(col->subid));
 		}
-		table->reverseColumns();
 	}
 
 	void loadTableWalk(Table* table, const DeviceTree* deviceTree, const ObjectID& oid, const ObjectConfig* config)
@@ -224,6 +431,10 @@ namespace snmpfs {
 			throw std::runtime_error("Could not create table");
 		}
 
+		// Columns unread for three intervals are no longer polled
+		if(config && config->skipUnread)
+			table->setSkipUnread(3 * 1000 * (uint64_t) config->interval);
+
 		return table;
 	}
 
@@ -262,14 +473,29 @@ namespace snmpfs {
 				{
 					obj = createTable(deviceTree, oid, &config);
 					// TODO Load inital data from tree ?
-					obj->update();
+					obj->refresh();
 				}
 				device->registerObject(obj, config.interval);
+
+				// Adaptive polling between the configured bounds
+				if(config.minInterval || config.maxInterval)
+				{
+					uint32_t minInterval = config.minInterval ? config.minInterval : config.interval;
+					uint32_t maxInterval = config.maxInterval ? config.maxInterval : config.interval;
+					obj->setIntervalBounds(std::min(minInterval, maxInterval), std::max(minInterval, maxInterval));
+				}
 			}
 
 			if(!obj) return;
 
-			ObjectNode* node = new ObjectNode(config.name, obj);
+			// Objects shared by multiple entries use the shortest max age
+			uint64_t maxAge = 1000ull * config.maxAge;
+			if(maxAge && (!obj->getMaxAge() || maxAge < obj->getMaxAge()))
+				obj->setMaxAge(maxAge);
+
+			FileNode* node;
+			if(config.type == TABLE && config.directory)	node = new TableNode(config.name, (Table*) obj, &device->getFS()->graveyard);
+			else											node = new ObjectNode(config.name, obj);
 			parentNode->addChild(node);
 			obj->notifyChanged();
 			obj->notifyUpdated();
@@ -286,10 +512,11 @@ namespace snmpfs {
 
 	void createTreeFromMIB(DeviceTree* deviceTree, FileNode* parentNode, const ObjectConfig& config, const ObjectID& oid)
 	{
-		tree* tr = oid.getMIB();
-		// printf("Creating tree from MIB for %s (%s)\n", ((std::string) oid).c_str(), tr->label);
+		const MIBIndex& index = MIBIndex::global();
+		const MIBNode* tr = oid.getMIB();
+		// printf("Creating tree from MIB for %s (%s)\n", ((std::string) oid).c_str(), index.getLabel(tr));
 
-		std::string name = tr->label;
+		std::string name = index.getLabel(tr);
 		std::transform(name.begin(), name.end(), name.begin(), tolower);
 
 		if(name.ends_with("table"))
@@ -299,22 +526,34 @@ namespace snmpfs {
 			tableConfig.rawOID	= (std::string) oid;
 			tableConfig.type	= TABLE;
 			tableConfig.interval= config.interval;
+			tableConfig.maxAge	= config.maxAge;
+			tableConfig.minInterval	= config.minInterval;
+			tableConfig.maxInterval	= config.maxInterval;
+			tableConfig.directory	= config.directory;
+			tableConfig.skipUnread	= config.skipUnread;
 
 			createNodes(deviceTree, parentNode, tableConfig);
 		}
-		else if(tr->child_list)
+		else if(tr->childCount > 0)
 		{
 			// FOUND FOLDER NODE
 			FileNode* node = config.placeholder ? parentNode : new FileNode(config.name);
 
-			for(tree* child = tr->child_list; child; child = child->next_peer)
+			const MIBNode* children = index.getChildren(tr);
+			for(uint32_t i = 0; i < tr->childCount; i++)
 			{
+				const MIBNode* child = children + i;
 				ObjectID childID = oid.getSubOID(child->subid);
 				ObjectConfig childConfig;
-				childConfig.name	= child->label;
+				childConfig.name	= index.getLabel(child);
 				childConfig.rawOID	= (std::string) childID;
 				childConfig.type	= TREE;
 				childConfig.interval= config.interval;
+				childConfig.maxAge	= config.maxAge;
+				childConfig.minInterval	= config.minInterval;
+				childConfig.maxInterval	= config.maxInterval;
+				childConfig.directory	= config.directory;
+				childConfig.skipUnread	= config.skipUnread;
 				createNodes(deviceTree, node, childConfig);
 			}
 
@@ -334,6 +573,9 @@ namespace snmpfs {
 			childConfig.rawOID	= (std::string) oid.getSubOID(0);
 			childConfig.type	= SCALAR;
 			childConfig.interval= config.interval;
+			childConfig.maxAge	= config.maxAge;
+			childConfig.minInterval	= config.minInterval;
+			childConfig.maxInterval	= config.maxInterval;
 
 			createNodes(deviceTree, parentNode, childConfig);
 		}
@@ -352,6 +594,9 @@ namespace snmpfs {
 			childConfig.rawOID	= (std::string) chld->getOID();
 			childConfig.type	= SCALAR;
 			childConfig.interval= config.interval;
+			childConfig.maxAge	= config.maxAge;
+			childConfig.minInterval	= config.minInterval;
+			childConfig.maxInterval	= config.maxInterval;
 
 			createNodes(deviceTree, parentNode, childConfig);
 		}
@@ -366,6 +611,9 @@ namespace snmpfs {
 			childConfig.rawOID	= (std::string) chld->getOID();
 			childConfig.type	= TABLE;
 			childConfig.interval= config.interval;
+			childConfig.maxAge	= config.maxAge;
+			childConfig.minInterval	= config.minInterval;
+			childConfig.maxInterval	= config.maxInterval;
 
 			createNodes(deviceTree, parentNode, childConfig);
 		}
@@ -381,6 +629,11 @@ namespace snmpfs {
 				childConfig.rawOID	= (std::string) childID;
 				childConfig.type	= TREE;
 				childConfig.interval= config.interval;
+				childConfig.maxAge	= config.maxAge;
+				childConfig.minInterval	= config.minInterval;
+				childConfig.maxInterval	= config.maxInterval;
+				childConfig.directory	= config.directory;
+				childConfig.skipUnread	= config.skipUnread;
 				createNodes(deviceTree, node, childConfig);
 			}
 
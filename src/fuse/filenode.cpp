@@ -1,4 +1,6 @@
 #include "fuse/filenode.h"
+
+#include <algorithm>
 #include <sys/stat.h>
 
 namespace snmpfs {
@@ -23,6 +25,18 @@ namespace snmpfs {
 		children.push_back(node);
 	}
 
+	/**
+	 * Detaches the child without freeing it
+	 */
+	bool FileNode::removeChild(FileNode* node)
+	{
+		auto it = std::find(children.begin(), children.end(), node);
+		if(it == children.end())
+			return false;
+		children.erase(it);
+		return true;
+	}
+
 	void FileNode::freeChilds()
 	{
 		for(FileNode* child : children)
@@ -33,7 +47,7 @@ namespace snmpfs {
 		children.clear();
 	}
 
-	FileNode* FileNode::getChildByName(std::string name) const
+	FileNode* FileNode::getChildByName(std::string name)
 	{
 		for(FileNode* child : children)
 		{
@@ -42,6 +56,14 @@ namespace snmpfs {
 		return nullptr;
 	}
 
+	std::vector<std::string> FileNode::getChildNames() const
+	{
+		std::vector<std::string> names;
+		for(const FileNode* child : children)
+			names.push_back(child->name);
+		return names;
+	}
+
 	std::string FileNode::printFileTree() const
 	{
 		std::stringstream stream;
@@ -92,6 +114,11 @@ namespace snmpfs {
 		return 0;
 	}
 
+	bool FileNode::snapshot(std::string& data)
+	{
+		return false;
+	}
+
 
 
 
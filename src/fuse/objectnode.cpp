@@ -25,6 +25,9 @@ namespace snmpfs {
 
 	int ObjectNode::open(bool trunc)
 	{
+		// Parked or too old objects are refreshed before they are read
+		object->touch();
+		if(object->wake() || object->isStale()) object->refresh();
 		if(trunc)	return truncate(0);
 		else		return 0;
 	}
@@ -0,0 +1,352 @@
+#include "fuse/tablenode.h"
+
+#include "fuse/objectnode.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace snmpfs {
+
+	TableNode::TableNode(std::string name, Table* table, Graveyard* graveyard) : FileNode(name), table(table)
+	{
+		ObjectNode* data = new ObjectNode("data", table);
+		addChild(data);
+
+		FileNode* columns = new FileNode("columns");
+		for(const std::string& column : table->getColumnNames())
+			columns->addChild(new TableColumnNode(column, table, data));
+		addChild(columns);
+
+		addChild(new TableRowsNode("rows", table, data, graveyard));
+		addChild(new TableWhereNode("where", table, data, graveyard));
+	}
+
+	TableNode::~TableNode()
+	{
+
+	}
+
+
+
+	TableRowsNode::TableRowsNode(std::string name, Table* table, const FileNode* timeSource, Graveyard* graveyard) : FileNode(name), table(table), timeSource(timeSource), graveyard(graveyard)
+	{
+
+	}
+
+	FileNode* TableRowsNode::getChildByName(std::string name)
+	{
+		// Rows can only disappear while the Table is updated
+		uint32_t generation = table->getGeneration();
+		if(generation != pruned)
+		{
+			pruneRows();
+			pruned = generation;
+		}
+
+		TableIndex index;
+		if(!Table::parseIndex(name, index) || !table->hasRow(index))
+			return nullptr;
+
+		auto it = rowNodes.find(name);
+		if(it != rowNodes.end()) return it->second;
+
+		TableRowNode* row = new TableRowNode(name, table, index, timeSource);
+		rowNodes[name] = row;
+		addChild(row);
+		return row;
+	}
+
+	/**
+	 * Removes the nodes of rows no longer in the Table, running calls might still use them
+	 */
+	void TableRowsNode::pruneRows()
+	{
+		for(auto it = rowNodes.begin(); it != rowNodes.end();)
+		{
+			TableRowNode* row = it->second;
+			if(table->hasRow(row->getIndex()))
+			{
+				it++;
+				continue;
+			}
+
+			removeChild(row);
+			it = rowNodes.erase(it);
+			graveyard->bury([row]()
+			{
+				row->freeChilds();
+				delete row;
+			});
+		}
+	}
+
+	std::vector<std::string> TableRowsNode::getChildNames() const
+	{
+		std::vector<std::string> names;
+		for(const TableIndex& index : table->getRowIndices())
+			names.push_back(Table::formatIndex(index));
+		return names;
+	}
+
+	timespec TableRowsNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableRowsNode::getTimeModification() const		{ return timeSource->getTimeModification(); }
+	timespec TableRowsNode::getTimeStatusChange() const		{ return timeSource->getTimeStatusChange(); }
+
+
+
+	TableRowNode::TableRowNode(std::string name, Table* table, const TableIndex& index, const FileNode* timeSource) : FileNode(name), table(table), index(index), timeSource(timeSource)
+	{
+
+	}
+
+	FileNode* TableRowNode::getChildByName(std::string name)
+	{
+		if(!table->hasRow(index))
+			return nullptr;
+
+		FileNode* cell = FileNode::getChildByName(name);
+		if(cell) return cell;
+
+		std::vector<std::string> columns = table->getColumnNames();
+		if(std::find(columns.begin(), columns.end(), name) == columns.end())
+			return nullptr;
+
+		cell = new TableCellNode(name, table, index, timeSource);
+		addChild(cell);
+		return cell;
+	}
+
+	std::vector<std::string> TableRowNode::getChildNames() const
+	{
+		return table->getColumnNames();
+	}
+
+	timespec TableRowNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableRowNode::getTimeModification() const		{ return timeSource->getTimeModification(); }
+	timespec TableRowNode::getTimeStatusChange() const		{ return timeSource->getTimeStatusChange(); }
+
+
+
+	TableWhereNode::TableWhereNode(std::string name, Table* table, const FileNode* timeSource, Graveyard* graveyard) : FileNode(name), table(table), timeSource(timeSource), graveyard(graveyard)
+	{
+
+	}
+
+	FileNode* TableWhereNode::getChildByName(std::string name)
+	{
+		size_t separator = name.find('=');
+		if(separator == std::string::npos)
+			return nullptr;
+
+		std::string column	= name.substr(0, separator);
+		std::string value	= name.substr(separator + 1);
+
+		std::vector<std::string> columns = table->getColumnNames();
+		if(std::find(columns.begin(), columns.end(), column) == columns.end())
+			return nullptr;
+
+		// Any value can be looked up, so nodes are buried right away instead of being kept
+		FileNode* query = new TableQueryNode(name, table, column, value, timeSource);
+		graveyard->bury([query]() { delete query; });
+		return query;
+	}
+
+	std::vector<std::string> TableWhereNode::getChildNames() const
+	{
+		// Possible queries can not be listed
+		return {};
+	}
+
+	timespec TableWhereNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableWhereNode::getTimeModification() const	{ return timeSource->getTimeModification(); }
+	timespec TableWhereNode::getTimeStatusChange() const	{ return timeSource->getTimeStatusChange(); }
+
+
+
+	TableQueryNode::TableQueryNode(std::string name, Table* table, const std::string& column, const std::string& value, const FileNode* timeSource) : FileNode(name), table(table), column(column), value(value), timeSource(timeSource)
+	{
+
+	}
+
+	int TableQueryNode::open(bool trunc)
+	{
+		// Whole rows are returned, so every column is read
+		table->touch();
+		if(table->wake() || table->isStale()) table->refresh();
+		return 0;
+	}
+
+	int TableQueryNode::read(char* buf, size_t size, off_t offset)
+	{
+		std::string data = table->getMatchingRows(column, value);
+
+		if(offset >= (off_t) data.size())
+			return 0;
+
+		if(data.size() - offset < size)
+			size = data.size() - offset;
+
+		memcpy(buf, data.data() + offset, size);
+		return size;
+	}
+
+	int TableQueryNode::write(const char* buf, size_t size, off_t offset)
+	{
+		return -EACCES;
+	}
+
+	bool TableQueryNode::snapshot(std::string& data)
+	{
+		data = table->getMatchingRows(column, value);
+		return true;
+	}
+
+	uint64_t TableQueryNode::getMode() const
+	{
+		uint64_t mode = 0;
+
+		// Regular File
+		mode |= S_IFREG;
+
+		// Read by Owner and Group
+		if(table->isReadable())
+			mode |= S_IRUSR | S_IRGRP;
+
+		return mode;
+	}
+
+	uint64_t TableQueryNode::getSize() const
+	{
+		return table->getMatchingSize(column, value);
+	}
+
+	timespec TableQueryNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableQueryNode::getTimeModification() const	{ return timeSource->getTimeModification(); }
+	timespec TableQueryNode::getTimeStatusChange() const	{ return timeSource->getTimeStatusChange(); }
+
+
+
+	TableColumnNode::TableColumnNode(std::string name, Table* table, const FileNode* timeSource) : FileNode(name), table(table), timeSource(timeSource)
+	{
+
+	}
+
+	int TableColumnNode::open(bool trunc)
+	{
+		table->touchColumn(name);
+		if(table->wake() || table->isStale()) table->refresh();
+		return 0;
+	}
+
+	int TableColumnNode::read(char* buf, size_t size, off_t offset)
+	{
+		std::string data = table->getColumnData(name);
+
+		if(offset >= (off_t) data.size())
+			return 0;
+
+		if(data.size() - offset < size)
+			size = data.size() - offset;
+
+		memcpy(buf, data.data() + offset, size);
+		return size;
+	}
+
+	int TableColumnNode::write(const char* buf, size_t size, off_t offset)
+	{
+		// Columns are written through the 'data' file of the table
+		return -EACCES;
+	}
+
+	bool TableColumnNode::snapshot(std::string& data)
+	{
+		data = table->getColumnData(name);
+		return true;
+	}
+
+	uint64_t TableColumnNode::getMode() const
+	{
+		uint64_t mode = 0;
+
+		// Regular File
+		mode |= S_IFREG;
+
+		// Read by Owner and Group
+		if(table->getColumnOID(name).isReadable())
+			mode |= S_IRUSR | S_IRGRP;
+
+		return mode;
+	}
+
+	uint64_t TableColumnNode::getSize() const
+	{
+		return table->getColumnSize(name);
+	}
+
+	timespec TableColumnNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableColumnNode::getTimeModification() const	{ return timeSource->getTimeModification(); }
+	timespec TableColumnNode::getTimeStatusChange() const	{ return timeSource->getTimeStatusChange(); }
+
+
+
+	TableCellNode::TableCellNode(std::string name, Table* table, const TableIndex& index, const FileNode* timeSource) : FileNode(name), table(table), index(index), timeSource(timeSource)
+	{
+
+	}
+
+	int TableCellNode::open(bool trunc)
+	{
+		table->touchColumn(name);
+		if(table->wake() || table->isStale()) table->refresh();
+		return 0;
+	}
+
+	int TableCellNode::read(char* buf, size_t size, off_t offset)
+	{
+		std::string data;
+		if(!table->getCellData(index, name, data))
+			return -ENOENT;
+
+		if(offset >= (off_t) data.size())
+			return 0;
+
+		if(data.size() - offset < size)
+			size = data.size() - offset;
+
+		memcpy(buf, data.data() + offset, size);
+		return size;
+	}
+
+	int TableCellNode::write(const char* buf, size_t size, off_t offset)
+	{
+		// Cells are written through the 'data' file of the table
+		return -EACCES;
+	}
+
+	uint64_t TableCellNode::getMode() const
+	{
+		uint64_t mode = 0;
+
+		// Regular File
+		mode |= S_IFREG;
+
+		// Read by Owner and Group
+		if(table->getColumnOID(name).isReadable())
+			mode |= S_IRUSR | S_IRGRP;
+
+		return mode;
+	}
+
+	uint64_t TableCellNode::getSize() const
+	{
+		std::string data;
+		if(!table->getCellData(index, name, data))
+			return 0;
+		return data.size();
+	}
+
+	timespec TableCellNode::getTimeAccess() const			{ return timeSource->getTimeAccess(); }
+	timespec TableCellNode::getTimeModification() const		{ return timeSource->getTimeModification(); }
+	timespec TableCellNode::getTimeStatusChange() const		{ return timeSource->getTimeStatusChange(); }
+
+}	// namespace snmpfs
@@ -57,6 +57,25 @@ namespace snmpfs {
 		// SNMP Timestamps
 		addProcFile(proc, "snmp_last_request",		&data->snmpLastRequest);
 
+		// DEVICE Initialization
+		addProcFile(proc, "device_init",			&data->deviceInit);
+
+		// TRAP Counters
+		addProcFile(proc, "trap_threads",			&data->trapThreads);
+		addProcFile(proc, "trap_received",			&data->trapReceived);
+		addProcFile(proc, "trap_rejected",			&data->trapRejected);
+
+		// CONFIG Reload
+		addProcFile(proc, "config_reload",			&data->configReload);
+
+		// TASK Counters
+		addProcFile(proc, "task_workers",			&data->taskWorkers);
+		addProcFile(proc, "task_queue_length",		&data->taskQueueLength);
+		addProcFile(proc, "task_wait_time",			&data->taskWaitTime);
+		addProcFile(proc, "task_wait_max",			&data->taskWaitMax);
+		addProcFile(proc, "task_steals",			&data->taskSteals);
+		addProcFile(proc, "task_scheduler_lag",		&data->taskSchedulerLag);
+
 		return proc;
 	}
 
@@ -0,0 +1,493 @@
+#include "reload.h"
+
+#include "configio.h"
+#include "deviceinit.h"
+#include "fuse/objectnode.h"
+#include "snmp/device.h"
+#include "snmp/devicetree.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+
+namespace snmpfs {
+
+	static std::atomic<ConfigReloader*> activeReloader = nullptr;
+
+	/**
+	 * Collects the Objects shown by the node and all nodes below it
+	 */
+	static void collectObjects(const FileNode* node, std::vector<Object*>& objects)
+	{
+		const ObjectNode* objectNode = dynamic_cast<const ObjectNode*>(node);
+		if(objectNode)
+			objects.push_back(objectNode->getObject());
+
+		for(const FileNode* child : node->children)
+			collectObjects(child, objects);
+	}
+
+	/**
+	 * Nodes are freed with their children, before the Objects they observe
+	 */
+	static void buryNode(Graveyard& graveyard, FileNode* node)
+	{
+		graveyard.bury([node]()
+		{
+			node->freeChilds();
+			delete node;
+		});
+	}
+
+	/**
+	 * Devices whose connection settings differ are created again
+	 */
+	static bool sameConnection(const DeviceConfig& c0, const DeviceConfig& c1)
+	{
+		return c0.peername == c1.peername
+			&& c0.walkConcurrency == c1.walkConcurrency
+			&& c0.parkAfter == c1.parkAfter
+			&& c0.auth == c1.auth;
+	}
+
+	/**
+	 * Returns true if the Object of c0 can keep its data and just move to the UpdateTask of the new interval
+	 */
+	static bool onlyIntervalChanged(const ObjectConfig& c0, const ObjectConfig& c1)
+	{
+		// Tables skipping unread columns derive their timeout from the interval
+		if(c1.type != SCALAR && (c1.type != TABLE || c1.skipUnread))
+			return false;
+
+		ObjectConfig other = c1;
+		other.interval = c0.interval;
+		return c0.interval != c1.interval && c0 == other;
+	}
+
+	/**
+	 * Drops Objects whose OIDs can't be resolved with the loaded MIBs, they would abort building the DeviceTree
+	 */
+	static void dropUnresolvable(DeviceConfig& device)
+	{
+		std::erase_if(device.objects.edit(), [&device](const ObjectConfig& object)
+		{
+			try
+			{
+				ObjectID oid(object.rawOID);
+				for(const ConfigEntry& column : object.columns)
+					ObjectID columnID(column.rawOID);
+				return false;
+			}
+			catch(const std::exception& e)
+			{
+				syslog(LOG_WARNING, "[%s] Skipping %s: %s\n", device.name.c_str(), object.name.c_str(), e.what());
+				return true;
+			}
+		});
+	}
+
+
+
+	ConfigReloader::ConfigReloader(snmpFS* snmpfs, const snmpfsConfig& config) : snmpfs(snmpfs), config(config), running(true)
+	{
+		sem_init(&requests, 0, 0);
+		thread = std::thread(&ConfigReloader::run, this);
+		activeReloader = this;
+	}
+
+	ConfigReloader::~ConfigReloader()
+	{
+		stop();
+		sem_destroy(&requests);
+	}
+
+	/**
+	 * Only posts a semaphore, so it can be called from signal handlers
+	 */
+	void ConfigReloader::request()
+	{
+		sem_post(&requests);
+	}
+
+	void ConfigReloader::stop()
+	{
+		activeReloader = nullptr;
+		if(!thread.joinable()) return;
+
+		running = false;
+		sem_post(&requests);
+		thread.join();
+	}
+
+	void ConfigReloader::signal(int signal)
+	{
+		ConfigReloader* reloader = activeReloader;
+		if(reloader) reloader->request();
+	}
+
+	void ConfigReloader::run()
+	{
+		while(true)
+		{
+			// Wakes up every second to free what reloads left behind
+			timespec timeout;
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_sec += 1;
+			bool requested = sem_timedwait(&requests, &timeout) == 0;
+			if(!running)
+				break;
+
+			reapInitTasks();
+			snmpfs->graveyard.collect();
+			if(!requested)
+				continue;
+
+			// Requests that piled up meanwhile are served by a single reload
+			while(sem_trywait(&requests) == 0);
+			reload();
+		}
+	}
+
+	/**
+	 * Drops DeviceInitTasks whose Devices are all READY or FAILED, lookups might still be waiting on them
+	 */
+	void ConfigReloader::reapInitTasks()
+	{
+		std::vector<DeviceInitTask*> done;
+		snmpfs->mutex.lock();
+		std::erase_if(snmpfs->initTasks, [&done](DeviceInitTask* initTask)
+		{
+			if(!initTask->isDone()) return false;
+			done.push_back(initTask);
+			return true;
+		});
+		snmpfs->mutex.unlock();
+
+		for(DeviceInitTask* initTask : done)
+		{
+			snmpfs->graveyard.bury([initTask]()
+			{
+				initTask->stop();
+				delete initTask;
+			});
+		}
+	}
+
+	/**
+	 * Reads the configuration file again and applies the Devices that were added, removed or changed
+	 */
+	bool ConfigReloader::reload()
+	{
+		syslog(LOG_INFO, "Reloading configuration from %s\n", config.configPath.c_str());
+
+		snmpfsConfig next;
+		if(!ConfigIO::read(config.configPath, next))
+		{
+			syslog(LOG_ERR, "Invalid configuration, keeping the running one\n");
+			snmpfs->proc.configReload.set("result,added,removed,changed,deferred\ninvalid,0,0,0,0\n");
+			return false;
+		}
+
+		// Only Devices are reloaded, the rest is set up once while mounting
+		if(next.workers != config.workers || next.trap.port != config.trap.port || next.trap.threads != config.trap.threads || next.trap.auth != config.trap.auth
+			|| next.mibs != config.mibs || next.loadSystemMIBs != config.loadSystemMIBs || next.selectiveMIBs != config.selectiveMIBs)
+		{
+			syslog(LOG_NOTICE, "Changes to workers, traps or MIBs require a remount\n");
+		}
+
+		std::map<std::string, const DeviceConfig*> current;
+		for(const DeviceConfig& device : config.devices)
+			current[device.name] = &device;
+
+		std::vector<DeviceConfig> devices;		///< configuration applied after this reload
+		std::vector<DeviceConfig> created;		///< Devices to initialize, new or changed too much
+		size_t added = 0, removed = 0, changed = 0, deferred = 0;
+
+		for(DeviceConfig device : next.devices)
+		{
+			auto it = current.find(device.name);
+			if(it == current.end())
+			{
+				dropUnresolvable(device);
+				created.push_back(device);
+				devices.push_back(device);
+				added++;
+				continue;
+			}
+
+			const DeviceConfig& running = *it->second;
+			current.erase(it);
+			if(running == device)
+			{
+				devices.push_back(running);
+				continue;
+			}
+
+			// Devices still initializing keep the old configuration, a later reload applies the changes
+			if(isPending(device.name))
+			{
+				syslog(LOG_NOTICE, "[%s] Still initializing, changes are deferred\n", device.name.c_str());
+				devices.push_back(running);
+				deferred++;
+				continue;
+			}
+
+			dropUnresolvable(device);
+			Device* instance = findDevice(device.name);
+			if(!instance || !sameConnection(running, device) || !updateDevice(instance, running, device))
+			{
+				removeDevice(device.name);
+				created.push_back(device);
+			}
+			devices.push_back(device);
+			changed++;
+		}
+
+		for(const auto& [name, running] : current)
+		{
+			if(isPending(name))
+			{
+				syslog(LOG_NOTICE, "[%s] Still initializing, removal is deferred\n", name.c_str());
+				devices.push_back(*running);
+				deferred++;
+				continue;
+			}
+
+			removeDevice(name);
+			removed++;
+		}
+
+		if(!created.empty())
+			addDevices(created, next.initConcurrency);
+		config.devices = devices;
+
+		std::stringstream ss;
+		ss << "result,added,removed,changed,deferred" << std::endl;
+		ss << "ok," << added << "," << removed << "," << changed << "," << deferred << std::endl;
+		snmpfs->proc.configReload.set(ss.str());
+
+		syslog(LOG_INFO, "Configuration reloaded: %lu added, %lu removed, %lu changed, %lu deferred\n", added, removed, changed, deferred);
+		return true;
+	}
+
+	/**
+	 * Returns true if the Device was neither initialized nor has failed yet
+	 */
+	bool ConfigReloader::isPending(const std::string& name)
+	{
+		snmpfs->mutex.lock();
+		std::vector<DeviceInitTask*> initTasks = snmpfs->initTasks;
+		snmpfs->mutex.unlock();
+
+		// Devices added again are handled by the latest Task
+		for(auto it = initTasks.rbegin(); it != initTasks.rend(); it++)
+		{
+			if((*it)->hasDevice(name))
+				return (*it)->isPending(name);
+		}
+		return false;
+	}
+
+	Device* ConfigReloader::findDevice(const std::string& name)
+	{
+		Device* device = nullptr;
+		snmpfs->mutex.lock();
+		for(Device* dev : snmpfs->devices)
+		{
+			if(dev->getName() == name)
+				device = dev;
+		}
+		snmpfs->mutex.unlock();
+		return device;
+	}
+
+	void ConfigReloader::addDevices(const std::vector<DeviceConfig>& devices, uint32_t concurrency)
+	{
+		DeviceInitTask* initTask = new DeviceInitTask(snmpfs, devices, concurrency);
+
+		snmpfs->mutex.lock();
+		for(const DeviceConfig& device : devices)
+			snmpfs->root->addChild(new FileNode(device.name));
+		snmpfs->initTasks.push_back(initTask);
+		snmpfs->mutex.unlock();
+
+		initTask->start();
+	}
+
+	void ConfigReloader::removeDevice(const std::string& name)
+	{
+		snmpfs->mutex.lock();
+		Device* device = nullptr;
+		auto it = std::find_if(snmpfs->devices.begin(), snmpfs->devices.end(), [&name](Device* dev) { return dev->getName() == name; });
+		if(it != snmpfs->devices.end())
+		{
+			device = *it;
+			snmpfs->devices.erase(it);
+			snmpfs->deviceSnapshot.set(snmpfs->devices);
+		}
+
+		FileNode* node = snmpfs->root->getChildByName(name);
+		if(node)
+		{
+			snmpfs->root->removeChild(node);
+			buryNode(snmpfs->graveyard, node);
+		}
+		snmpfs->mutex.unlock();
+
+		if(device)
+		{
+			device->stopUpdates();
+			device->logInfo("Removed by configuration reload");
+			snmpfs->graveyard.bury([device]()
+			{
+				device->freeObjects();
+				device->cleanupSNMP();
+				delete device;
+			}, true);
+		}
+	}
+
+	/**
+	 * Applies the changed Objects of an initialized Device, returns false if the Device has to be created again instead.
+	 * Objects that could not be created are dropped from next, so the following reload tries again.
+	 */
+	bool ConfigReloader::updateDevice(Device* device, const DeviceConfig& current, DeviceConfig& next)
+	{
+		std::map<std::string, const ObjectConfig*> oldObjects, newObjects;
+		for(const ObjectConfig& object : current.objects)	oldObjects[object.name] = &object;
+		for(const ObjectConfig& object : next.objects)		newObjects[object.name] = &object;
+
+		// Placeholder trees put their nodes right into the Device directory, so they can't be replaced on their own
+		auto placeholderChanged = [](const std::vector<ObjectConfig>& objects, const std::map<std::string, const ObjectConfig*>& others)
+		{
+			return std::any_of(objects.begin(), objects.end(), [&others](const ObjectConfig& object)
+			{
+				auto it = others.find(object.name);
+				return object.placeholder && (it == others.end() || !(*it->second == object));
+			});
+		};
+		if(placeholderChanged(current.objects.get(), newObjects) || placeholderChanged(next.objects.get(), oldObjects))
+			return false;
+
+		snmpfs->mutex.lock();
+		FileNode* deviceNode = snmpfs->root->getChildByName(device->getName());
+		if(!deviceNode)
+		{
+			snmpfs->mutex.unlock();
+			return false;
+		}
+
+		std::vector<Object*> shown;
+		collectObjects(deviceNode, shown);
+
+		std::vector<ObjectConfig> create;
+		std::vector<Object*> detached;
+		for(const ObjectConfig& object : current.objects)
+		{
+			auto it = newObjects.find(object.name);
+			if(it != newObjects.end() && *it->second == object)
+				continue;
+
+			FileNode* node = deviceNode->getChildByName(object.name);
+			if(!node)
+			{
+				// Scalars missing on the Device have no node
+				if(it != newObjects.end()) create.push_back(*it->second);
+				continue;
+			}
+
+			std::vector<Object*> objects;
+			collectObjects(node, objects);
+
+			// Moving the Object to another UpdateTask keeps its data, unless other entries share it
+			if(it != newObjects.end() && onlyIntervalChanged(object, *it->second) && objects.size() == 1
+				&& std::count(shown.begin(), shown.end(), objects[0]) == 1
+				&& !device->lookupObject(objects[0]->getID(), it->second->interval))
+			{
+				device->unregisterObject(objects[0]);
+				device->registerObject(objects[0], it->second->interval);
+				continue;
+			}
+
+			// Replaced nodes might still be in use by filesystem calls
+			deviceNode->removeChild(node);
+			buryNode(snmpfs->graveyard, node);
+			detached.insert(detached.end(), objects.begin(), objects.end());
+			if(it != newObjects.end()) create.push_back(*it->second);
+		}
+		snmpfs->mutex.unlock();
+
+		for(const ObjectConfig& object : next.objects)
+		{
+			if(!oldObjects.contains(object.name))
+				create.push_back(object);
+		}
+
+		// Detached Objects are still registered, so unchanged OIDs are picked up again by lookupObject
+		if(!create.empty())
+		{
+			FileNode* staging = new FileNode(device->getName());
+			DeviceTree* deviceTree = DeviceTree::fromConfig(device, create);
+			for(const ObjectConfig& object : create)
+			{
+				try
+				{
+					createNodes(deviceTree, staging, object);
+				}
+				catch(const std::exception& e)
+				{
+					device->logErr("Could not create " + object.name + ": " + e.what());
+					std::erase_if(next.objects.edit(), [&object](const ObjectConfig& o) { return o.name == object.name; });
+				}
+			}
+			delete deviceTree;
+
+			snmpfs->mutex.lock();
+			for(FileNode* child : staging->children)
+				deviceNode->addChild(child);
+			snmpfs->mutex.unlock();
+			staging->children.clear();
+			delete staging;
+		}
+
+		// Objects no longer shown by any node are not polled anymore
+		snmpfs->mutex.lock();
+		shown.clear();
+		collectObjects(deviceNode, shown);
+		snmpfs->mutex.unlock();
+
+		std::set<Object*> remaining(shown.begin(), shown.end());
+		std::set<Object*> unused(detached.begin(), detached.end());
+		for(Object* obj : unused)
+		{
+			if(remaining.contains(obj))
+				continue;
+			device->unregisterObject(obj);
+			snmpfs->graveyard.bury([obj]() { delete obj; }, true);
+		}
+
+		device->logInfo("Configuration reloaded");
+		return true;
+	}
+
+	ReloadNode::ReloadNode(std::string name, ConfigReloader* reloader) : VirtualFile(name), reloader(reloader)
+	{
+
+	}
+
+	int ReloadNode::write(const char* buf, size_t size, off_t offset)
+	{
+		reloader->request();
+		return size;
+	}
+
+	uint64_t ReloadNode::getMode() const
+	{
+		return S_IFREG | S_IWUSR;
+	}
+
+}	// namespace snmpfs
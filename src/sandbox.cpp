@@ -1,13 +1,16 @@
 #include "sandbox.h"
 
+#include "configio.h"
 #include "core/tqueue.h"
 #include "core/util.h"
 #include "demo.h"
 #include "deviceinit.h"
 #include "snmp/devicetree.h"
+#include "snmp/mibindex.h"
 #include "snmp/snmp_ext.h"
 #include "snmp/objectid.h"
 #include <cassert>
+#include <fstream>
 
 namespace snmpfs {
 
@@ -28,9 +31,11 @@ namespace snmpfs {
 		ObjectID root("iso");
 		printf("Has MIB: %s\n", root.hasMIB() ? "YES" : "NO");
 		printf("MIB: %p\n", (void*) root.getMIB());
-		for(tree* child = root.getMIB()->child_list; child; child = child->next_peer)
+		const MIBIndex& index = MIBIndex::global();
+		const MIBNode* children = index.getChildren(root.getMIB());
+		for(uint32_t i = 0; i < root.getMIB()->childCount; i++)
 		{
-			printf("--%s\n", child->label);
+			printf("--%s\n", index.getLabel(children + i));
 		}
 
 		exit(0);
@@ -666,7 +671,7 @@ namespace snmpfs {
 	{
 		// const ObjectID& oid(".1.3.6.1.3.1997.256");	// custom
 		const ObjectID& oid("iso.3.6.1.2.1.2.2");		// interfaces
-		tree* tr = ObjectID::toMIB(oid);
+		tree* tr = ObjectID::toMIB(oid) ? get_tree(oid, oid, get_tree_head()) : nullptr;
 
 		if(tr)
 			printf("Loading Table from MIB\n");
@@ -1405,6 +1410,63 @@ namespace snmpfs {
 		queue.next(&n1, &delay);
 	}
 
+	/**
+	 * Parses and expands a generated config with the given number of devices,
+	 * every device reuses nested templates and adds objects of its own
+	 */
+	void test_config_benchmark(size_t devices)
+	{
+		const size_t templates = 100;
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "snmpfs_benchmark.xml";
+
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::ofstream xml(path);
+			xml << "<snmpfs interval=\"60\">" << std::endl;
+			xml << "\t<mibs system=\"false\"/>" << std::endl;
+
+			for(size_t t = 0; t < templates; t++)
+			{
+				xml << "\t<template name=\"tmpl" << t << "\">" << std::endl;
+				for(size_t o = 0; o < 10; o++)
+					xml << "\t\t<scalar name=\"t" << t << "_" << o << "\" oid=\".1.3.6.1.4.1.1997." << t << "." << o << ".0\"/>" << std::endl;
+				xml << "\t\t<table name=\"table" << t << "\" oid=\".1.3.6.1.4.1.1997." << t << ".100\"/>" << std::endl;
+				if(t > 0)
+					xml << "\t\t<reuse name=\"tmpl" << t - 1 << "\" prefix=\"true\"/>" << std::endl;
+				xml << "\t</template>" << std::endl;
+			}
+
+			for(size_t d = 0; d < devices; d++)
+			{
+				xml << "\t<device name=\"device" << d << "\">" << std::endl;
+				xml << "\t\t<snmp peername=\"10.0." << d / 256 % 256 << "." << d % 256 << "\" version=\"2c\" community=\"public\"/>" << std::endl;
+				xml << "\t\t<objects>" << std::endl;
+				xml << "\t\t\t<scalar name=\"uptime\" oid=\".1.3.6.1.2.1.1.3.0\"/>" << std::endl;
+				xml << "\t\t\t<reuse name=\"tmpl" << d % 5 << "\"/>" << std::endl;
+				xml << "\t\t\t<reuse name=\"tmpl" << 5 + d % 5 << "\" interval=\"30\" prefix=\"true\"/>" << std::endl;
+				xml << "\t\t</objects>" << std::endl;
+				xml << "\t</device>" << std::endl;
+			}
+			xml << "</snmpfs>" << std::endl;
+		}
+		auto generated = std::chrono::steady_clock::now();
+
+		snmpfsConfig config;
+		bool suc = ConfigIO::read(path, config);
+		auto parsed = std::chrono::steady_clock::now();
+		std::filesystem::remove(path);
+
+		size_t objects = 0;
+		for(const DeviceConfig& device : config.devices)
+			objects += device.objects.size();
+
+		printf("Config benchmark: %s\n", suc ? "OK" : "FAILED");
+		printf("Devices:   %lu\n", config.devices.size());
+		printf("Objects:   %lu\n", objects);
+		printf("Generate:  %ld ms\n", std::chrono::duration_cast<std::chrono::milliseconds>(generated - start).count());
+		printf("Read:      %ld ms\n", std::chrono::duration_cast<std::chrono::milliseconds>(parsed - generated).count());
+	}
+
 
 }	// namespace snmpfs
 
@@ -21,6 +21,23 @@ namespace snmpfs {
 	{
 		logInfo("Initializing SNMP");
 
+		snmpHandle = openSession();
+		return snmpHandle != NULL;
+	}
+
+	void Device::cleanupSNMP()
+	{
+		logInfo("Closing SNMP session");
+		closeSession(snmpHandle);
+		snmpHandle = NULL;
+	}
+
+	/**
+	 * Opens an additional session to the Device using its configuration.
+	 * Each session must only be used by one thread at a time (see walkSubtree)
+	 */
+	void* Device::openSession() const
+	{
 		// SETUP SESSION
 		netsnmp_session snmpSession;
 		snmp_sess_init(&snmpSession);
@@ -83,7 +100,7 @@ namespace snmpfs {
 				if(res != SNMPERR_SUCCESS)
 				{
 					logErr("Error running generate_Ku\n");
-					return false;
+					return NULL;
 				}
 			}
 
@@ -110,15 +127,15 @@ namespace snmpfs {
 				if(res != SNMPERR_SUCCESS)
 				{
 					logErr("Error running generate_Ku\n");
-					return false;
+					return NULL;
 				}
 			}
 		}
 
 		// CONNECT
 		logInfo("Opening SNMP session");
-		snmpHandle = snmp_sess_open(&snmpSession);
-		if(snmpHandle == NULL)
+		void* handle = snmp_sess_open(&snmpSession);
+		if(handle == NULL)
 		{
 			char* err;
 			snmp_error(&snmpSession, NULL, NULL, &err);
@@ -126,22 +143,21 @@ namespace snmpfs {
 			delete err;
 
 			logErr("SNMP Session could not be created: " + error);
-			return false;
+			return NULL;
 		}
 
-		return true;
+		return handle;
 	}
 
-	void Device::cleanupSNMP()
+	void Device::closeSession(void* handle) const
 	{
-		logInfo("Closing SNMP session");
-		snmp_sess_close(snmpHandle);
-		snmpHandle = NULL;
+		if(handle) snmp_sess_close(handle);
 	}
 
 
 	void Device::freeObjects()
 	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
 		for(auto& [interval, task] : tasks)
 		{
 			for(const auto& [id, obj] : task.objects)
@@ -155,6 +171,7 @@ namespace snmpfs {
 
 	Object* Device::lookupObject(ObjectID oid, uint32_t interval) const
 	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
 		if(tasks.contains(interval))
 		{
 			const UpdateTask& task = tasks.at(interval);
@@ -163,26 +180,55 @@ namespace snmpfs {
 				return task.objects.at(oid);
 			}
 		}
+
+		// Adaptive objects might have moved to another task
+		for(const auto& [taskInterval, task] : tasks)
+		{
+			auto it = task.objects.find(oid);
+			if(it != task.objects.end() && it->second->getBaseInterval() == interval)
+				return it->second;
+		}
 		return nullptr;
 	}
 
 	void Device::registerObject(Object* obj, uint32_t interval)
 	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		obj->setInterval(interval);
 		UpdateTask& task = tasks[interval];
 		task.device = this;
 		task.setInterval(interval);
 		task.objects[obj->getID()] = obj;
-		snmpfs->taskManager.addTask(&task);
+		if(!stopped) snmpfs->taskManager.addTask(&task);
 	}
 
 	void Device::unregisterObject(Object* obj)
 	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
 		for(auto& [interval, task] : tasks)
 		{
-			task.objects.erase(obj->getID());
+			// Objects with the same OID but another interval are kept
+			auto it = task.objects.find(obj->getID());
+			if(it == task.objects.end() || it->second != obj)
+				continue;
+
+			task.objects.erase(it);
+			if(task.objects.empty())
+				snmpfs->taskManager.removeTask(&task);
 		}
 	}
 
+	/**
+	 * Stops polling all Objects, Tasks currently running finish without being rescheduled
+	 */
+	void Device::stopUpdates()
+	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		stopped = true;
+		for(auto& [interval, task] : tasks)
+			snmpfs->taskManager.removeTask(&task);
+	}
+
 
 
 
@@ -252,6 +298,11 @@ namespace snmpfs {
 	}
 
 	bool Device::next(ObjectID& oid, ObjectData& data) const
+	{
+		return next(oid, data, NULL);
+	}
+
+	bool Device::next(ObjectID& oid, ObjectData& data, void* handle) const
 	{
 		if(!snmpHandle)
 			std::runtime_error("Device is not connected");
@@ -262,7 +313,7 @@ namespace snmpfs {
 		pdu = snmp_pdu_create(SNMP_MSG_GETNEXT);
 		snmp_add_null_var(pdu, oid, oid);
 
-		if(!sendPDU(pdu, &response, "GetNext")) return false;
+		if(!sendPDU(handle, pdu, &response, "GetNext")) return false;
 		assert(response);
 
 		netsnmp_variable_list* var = response->variables;
@@ -300,6 +351,74 @@ namespace snmpfs {
 		return res[0];
 	}
 
+	/**
+	 * Retrieves multiple objects with as few GET requests as possible.
+	 * Objects that do not exist on the Device are left out of the result.
+	 */
+	std::vector<ObjectData> Device::get(const std::vector<ObjectID>& ids) const
+	{
+		std::vector<ObjectData> objects;
+		std::vector<ObjectID> pending = ids;
+
+		size_t batchSize	= pending.size();
+		size_t offset		= 0;
+		while(offset < pending.size())
+		{
+			size_t count = std::min(batchSize, pending.size() - offset);
+
+			netsnmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_GET);
+			for(size_t i = offset; i < offset + count; i++)
+				snmp_add_null_var(pdu, pending[i], pending[i]);
+
+			netsnmp_pdu* response;
+			if(!sendPDU(pdu, &response, "GET")) break;
+			assert(response);
+
+			// Agent can't fit the response into one message -> split request
+			if(response->errstat == SNMP_ERR_TOOBIG && count > 1)
+			{
+				snmp_free_pdu(response);
+				batchSize = std::max<size_t>(count / 2, 1);
+				continue;
+			}
+
+			// SNMPv1 rejects the whole request because of a single object -> retry without it
+			if(response->errstat != SNMP_ERR_NOERROR && response->errindex > 0 && (size_t) response->errindex <= count)
+			{
+				snmp_free_pdu(response);
+				pending.erase(pending.begin() + offset + response->errindex - 1);
+				continue;
+			}
+
+			if(response->errstat == SNMP_ERR_NOERROR)
+			{
+				for(netsnmp_variable_list* var = response->variables; var; var = var->next_variable)
+				{
+					if( var->type == SNMP_ENDOFMIBVIEW		||
+						var->type == SNMP_NOSUCHOBJECT		||
+						var->type == SNMP_NOSUCHINSTANCE	||
+						var->type == ASN_NULL)
+						continue;
+
+					ObjectData data = {};
+					data.id		= ObjectID(var->name, var->name_length);
+					data.type	= snmp_type2char(var->type);
+					data.valid	= formatVariable(var, data.data);
+					if(data.valid) objects.emplace_back(data);
+				}
+			}
+			else
+			{
+				logWarn("GET of " + std::to_string(count) + " objects failed with " + snmp_error_code_name(response->errstat));
+			}
+
+			snmp_free_pdu(response);
+			offset += count;
+		}
+
+		return objects;
+	}
+
 	ObjectData Device::set(ObjectID oid, char type, std::string data) const
 	{
 		if(!snmpHandle)
@@ -311,7 +430,9 @@ namespace snmpfs {
 		netsnmp_pdu* response;
 
 		pdu = snmp_pdu_create(SNMP_MSG_SET);
-		int suc_add = snmp_add_var(pdu, oid, oid, type, data.c_str());
+		int suc_add = MIBIndex::global().resolveValue(oid, oid.length(), type, data);
+		if(suc_add == SNMPERR_SUCCESS)
+			suc_add = snmp_add_var(pdu, oid, oid, type, data.c_str());
 		if(suc_add != 0)
 		{
 			// WE ASSUME THAT DATA IS ALWAYS SET CORRECTLY
@@ -336,6 +457,136 @@ namespace snmpfs {
 		return res[0];
 	}
 
+	/**
+	 * Sets multiple objects with as few SET requests as the agent accepts.
+	 * Returns one entry per given object in the same order, failed objects are
+	 * marked invalid with the error reported for them by the agent.
+	 * When the agent or snmp_add_var rejects an object nothing else is sent, unless partial is set,
+	 * then the remaining objects are sent again without the rejected one.
+	 * Requests split because of their size are never atomic as a whole.
+	 */
+	std::vector<ObjectData> Device::set(const std::vector<ObjectData>& objects, bool partial) const
+	{
+		std::vector<ObjectData> results(objects.size());
+		std::vector<size_t> pending;
+		for(size_t i = 0; i < objects.size(); i++)
+		{
+			results[i]			= objects[i];
+			results[i].valid	= false;
+			results[i].error	= 0;
+			pending.emplace_back(i);
+		}
+
+		// Objects not applied because of an earlier failure
+		auto abort = [&](size_t from, long error)
+		{
+			for(size_t i = from; i < pending.size(); i++)
+			{
+				if(!results[pending[i]].error)
+					results[pending[i]].error = error;
+			}
+		};
+
+		size_t batchSize	= pending.size();
+		size_t offset		= 0;
+		while(offset < pending.size())
+		{
+			size_t count = std::min(batchSize, pending.size() - offset);
+
+			// Objects rejected while building the request are not sent at all
+			netsnmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_SET);
+			std::vector<size_t> sent;
+			for(size_t i = offset; i < offset + count; i++)
+			{
+				const ObjectData& object = objects[pending[i]];
+				char type			= object.type;
+				std::string value	= object.data;
+				int suc_add = MIBIndex::global().resolveValue(object.id, object.id.length(), type, value);
+				if(suc_add == SNMPERR_SUCCESS)
+					suc_add = snmp_add_var(pdu, object.id, object.id, type, value.c_str());
+				if(suc_add != 0)	results[pending[i]].error = suc_add;
+				else				sent.emplace_back(pending[i]);
+			}
+
+			// The first request contains every object, so nothing was sent yet
+			if(!partial && sent.size() < count)
+			{
+				snmp_free_pdu(pdu);
+				abort(offset, SNMP_ERR_GENERR);
+				break;
+			}
+
+			if(sent.empty())
+			{
+				snmp_free_pdu(pdu);
+				offset += count;
+				continue;
+			}
+
+			netsnmp_pdu* response;
+			if(!sendPDU(pdu, &response, "SET"))
+			{
+				abort(offset, SNMP_ERR_GENERR);
+				break;
+			}
+			assert(response);
+
+			// Agent can't fit the response into one message -> split request
+			if(response->errstat == SNMP_ERR_TOOBIG && count > 1)
+			{
+				snmp_free_pdu(response);
+				batchSize = std::max<size_t>(count / 2, 1);
+				continue;
+			}
+
+			// SET is atomic, one failing object rejects the whole request
+			if(response->errstat != SNMP_ERR_NOERROR && response->errindex > 0 && (size_t) response->errindex <= sent.size())
+			{
+				size_t failed = sent[response->errindex - 1];
+				results[failed].error = response->errstat;
+				snmp_free_pdu(response);
+
+				if(!partial)
+				{
+					abort(offset, SNMP_ERR_GENERR);
+					break;
+				}
+
+				// Retry without it
+				pending.erase(std::find(pending.begin() + offset, pending.end(), failed));
+				continue;
+			}
+
+			if(response->errstat == SNMP_ERR_NOERROR)
+			{
+				size_t index = 0;
+				for(netsnmp_variable_list* var = response->variables; var && index < sent.size(); var = var->next_variable, index++)
+				{
+					ObjectData& data = results[sent[index]];
+					data.id		= ObjectID(var->name, var->name_length);
+					data.type	= snmp_type2char(var->type);
+					data.valid	= formatVariable(var, data.data);
+				}
+			}
+			else
+			{
+				for(size_t i : sent)
+					results[i].error = response->errstat;
+				if(!partial)
+				{
+					snmp_free_pdu(response);
+					abort(offset + count, SNMP_ERR_GENERR);
+					break;
+				}
+			}
+
+			snmp_free_pdu(response);
+			offset += count;
+		}
+
+		return results;
+	}
+
 	std::vector<ObjectData> Device::walk() const
 	{
 		if(!snmpHandle)
@@ -356,6 +607,15 @@ namespace snmpfs {
 	}
 
 	std::vector<ObjectData> Device::walkSubtree(const ObjectID& oid) const
+	{
+		return walkSubtree(oid, NULL);
+	}
+
+	/**
+	 * Walks the subtree using the given session handle (NULL for the main session).
+	 * Sessions from openSession() are not locked, so one walk per handle at a time
+	 */
+	std::vector<ObjectData> Device::walkSubtree(const ObjectID& oid, void* handle) const
 	{
 		if(!snmpHandle)
 			std::runtime_error("Device is not connected");
@@ -365,7 +625,7 @@ namespace snmpfs {
 		ObjectID currentOID = oid;
 		std::vector<ObjectData> objects;
 
-		while(next(currentOID, currentData))
+		while(next(currentOID, currentData, handle))
 		{
 			if(!oid.isAncestorOf(currentOID)) break;
 			objects.emplace_back(currentData);
@@ -404,13 +664,19 @@ namespace snmpfs {
 
 	void Device::update()
 	{
-		for(const auto& [interval, task] : tasks)
+		std::map<ObjectID, Object*> objects;
 		{
-			updateObjects(task.objects);
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			for(const auto& [interval, task] : tasks)
+				objects.insert(task.objects.begin(), task.objects.end());
 		}
+		updateObjects(objects);
 	}
 
-	bool Device::updateObjects(const std::map<ObjectID, Object*>& objects)
+	/**
+	 * Updates all given objects, if parkTime is set objects not read for parkTime ms are parked and skipped
+	 */
+	bool Device::updateObjects(const std::map<ObjectID, Object*>& objects, uint64_t parkTime)
 	{
 		if(!snmpHandle)
 			std::runtime_error("Device is not connected");
@@ -418,18 +684,61 @@ namespace snmpfs {
 		bool suc = true;
 		for(auto& [oid, obj] : objects)
 		{
-			suc &= obj->update();
+			if(parkTime && obj->park(parkTime)) continue;
+			bool refreshed = obj->refresh();
+			if(refreshed && obj->isAdaptive()) obj->adapt();
+			suc &= refreshed;
 		}
 
 		return suc;
 	}
 
+	/**
+	 * Moves adaptive objects of task whose interval changed to the task of their new interval.
+	 * Tasks left empty stay registered, they might still be running.
+	 */
+	void Device::regroupObjects(UpdateTask& task)
+	{
+		std::unique_lock<std::mutex> lock(tasksMutex);
+		for(auto it = task.objects.begin(); it != task.objects.end();)
+		{
+			Object* obj = it->second;
+			uint32_t interval = obj->getInterval();
+			if(interval == task.getInterval())
+			{
+				it++;
+				continue;
+			}
+
+			UpdateTask& target = tasks[interval];
+			target.device = this;
+			target.setInterval(interval);
+			target.objects[it->first] = obj;
+			if(!stopped) snmpfs->taskManager.addTask(&target);
+			it = task.objects.erase(it);
+		}
+	}
+
 
 	bool Device::sendPDU(netsnmp_pdu* pdu, netsnmp_pdu** response, const std::string& op) const
 	{
-		snmpMutex.lock();
-		int status = snmp_sess_synch_response(snmpHandle, pdu, response);
-		snmpMutex.unlock();
+		return sendPDU(NULL, pdu, response, op);
+	}
+
+	bool Device::sendPDU(void* handle, netsnmp_pdu* pdu, netsnmp_pdu** response, const std::string& op) const
+	{
+		int status;
+		if(handle == NULL || handle == snmpHandle)
+		{
+			// Main session is shared between all Tasks
+			snmpMutex.lock();
+			status = snmp_sess_synch_response(snmpHandle, pdu, response);
+			snmpMutex.unlock();
+		}
+		else
+		{
+			status = snmp_sess_synch_response(handle, pdu, response);
+		}
 
 		snmpfs->proc.snmpRequestCount.inc();
 		snmpfs->proc.snmpLastRequest.setNow();
@@ -522,17 +831,24 @@ namespace snmpfs {
 	{
 		std::vector<ObjectData> objs = processResponse(response);
 
-		for(const ObjectData& obj : objs)
+		// Traps are received by several threads while Objects might get registered, so targets are collected first
+		std::vector<std::pair<Object*, const ObjectData*>> updates;
 		{
-			if(!obj.valid) continue;
-			for(const auto& [interval, task] : tasks)
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			for(const ObjectData& obj : objs)
 			{
-				if(task.objects.contains(obj.id))
+				if(!obj.valid) continue;
+				for(const auto& [interval, task] : tasks)
 				{
-					task.objects.at(obj.id)->updateData(obj.id, obj.data);
+					// Cells of tables are written directly into the Table
+					for(Object* object : findOwners(task.objects, obj.id))
+						updates.emplace_back(object, &obj);
 				}
 			}
 		}
+
+		for(const auto& [object, obj] : updates)
+			object->updateData(obj->id, obj->data);
 		return true;
 	}
 
@@ -565,9 +881,24 @@ namespace snmpfs {
 
 	}
 
+	size_t UpdateTask::getAffinity() const
+	{
+		// All intervals of a Device share the same worker
+		return std::hash<std::string>()(device->config.name);
+	}
+
 	void UpdateTask::run()
 	{
-		device->updateObjects(objects);
+		std::map<ObjectID, Object*> objects;
+		{
+			// Objects might be registered or regrouped meanwhile
+			std::unique_lock<std::mutex> lock(device->tasksMutex);
+			objects = this->objects;
+		}
+
+		uint64_t parkTime = 1000ull * interval * device->config.parkAfter;
+		device->updateObjects(objects, parkTime);
+		device->regroupObjects(*this);
 		device->snmpfs->proc.snmpfsLastUpdate.setNow();
 	}
 
@@ -2,6 +2,10 @@
 
 #include "snmp/table.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 namespace snmpfs {
 
 	DeviceTree::DeviceTree()
@@ -27,6 +31,17 @@ namespace snmpfs {
 	 * Used to make initialization faster
 	 */
 	DeviceTree* DeviceTree::fromConfig(Device* device)
+	{
+		if(device == nullptr)
+			throw std::runtime_error("Can't build DeviceTree from nullptr");
+
+		return fromConfig(device, device->getConfig().objects.get());
+	}
+
+	/**
+	 * Walks only the subset of the Device needed by the given objects
+	 */
+	DeviceTree* DeviceTree::fromConfig(Device* device, const std::vector<ObjectConfig>& objects)
 	{
 		if(device == nullptr)
 			throw std::runtime_error("Can't build DeviceTree from nullptr");
@@ -35,13 +50,15 @@ namespace snmpfs {
 		root->device = device;
 
 		// OIDs could be used multiple times -> avoid walking them twice
+		// Only tables and trees are walked, scalars are fetched directly
 		std::set<ObjectID> oids;
-		for(const ObjectConfig& objectConfig : device->getConfig().objects)
+		std::set<ObjectID> scalarOIDs;
+		for(const ObjectConfig& objectConfig : objects)
 		{
 			ObjectID oid(objectConfig.rawOID);
 			if(objectConfig.type == SCALAR)
 			{
-				oids.emplace(oid.getParentID());
+				scalarOIDs.emplace(oid);
 			}
 			else
 			{
@@ -49,14 +66,73 @@ namespace snmpfs {
 			}
 		}
 
-		for(const ObjectID& oid : oids)
+		// Scalars inside a walked subtree are already covered by the walk
+		std::vector<ObjectID> scalars;
+		for(const ObjectID& scalar : scalarOIDs)
 		{
-			for(const ObjectData& data : device->walkSubtree(oid))
+			bool covered = std::any_of(oids.begin(), oids.end(), [&](const ObjectID& oid)
+			{
+				return oid.length() <= scalar.length() && oid.isAncestorOf(scalar);
+			});
+			if(!covered) scalars.push_back(scalar);
+		}
+
+		// Walk independent subtrees in parallel, each worker using its own session
+		const std::vector<ObjectID> subtrees(oids.begin(), oids.end());
+		std::vector<std::vector<ObjectData>> results(subtrees.size());
+
+		size_t workerCount = std::max<uint32_t>(device->getConfig().walkConcurrency, 1);
+		workerCount = std::min(workerCount, subtrees.size());
+
+		// Additional sessions for all but the first worker, which uses the main session
+		std::vector<void*> handles;
+		for(size_t w = 1; w < workerCount; w++)
+		{
+			void* handle = device->openSession();
+			if(!handle) break;
+			handles.push_back(handle);
+		}
+
+		std::atomic<size_t> nextSubtree = 0;
+		auto walker = [&](void* handle)
+		{
+			while(true)
+			{
+				size_t i = nextSubtree++;
+				if(i >= subtrees.size()) break;
+				results[i] = device->walkSubtree(subtrees[i], handle);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(void* handle : handles)
+			threads.emplace_back(walker, handle);
+
+		// Main session resolves all scalars with one multi-varbind GET before helping with walks
+		std::vector<ObjectData> scalarData;
+		if(!scalars.empty())
+			scalarData = device->get(scalars);
+		walker(nullptr);
+
+		for(std::thread& thread : threads)
+			thread.join();
+		for(void* handle : handles)
+			device->closeSession(handle);
+
+		// DeviceTree is not thread safe, so merge results afterwards
+		for(const std::vector<ObjectData>& result : results)
+		{
+			for(const ObjectData& data : result)
 			{
 				root->put(data.id, data);
 			}
 		}
 
+		for(const ObjectData& data : scalarData)
+		{
+			root->put(data.id, data);
+		}
+
 		return root;
 	}
 
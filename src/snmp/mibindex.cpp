@@ -0,0 +1,611 @@
+#include "snmp/mibindex.h"
+
+#include "core/util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snmpfs {
+
+	static const char MIB_INDEX_MAGIC[8]		= {'S', 'N', 'M', 'P', 'F', 'S', 'M', 'I'};
+	static const uint32_t MIB_INDEX_VERSION		= 1;
+
+	/**
+	 * File layout: header, nodes, enums, string pool
+	 */
+	struct MIBIndexHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t nodeSize;
+		uint64_t fingerprint;
+		uint32_t nodeCount;
+		uint32_t enumCount;
+		uint32_t stringSize;
+		uint32_t rootCount;
+	};
+
+	MIBIndex::MIBIndex()
+	{
+
+	}
+
+	MIBIndex::~MIBIndex()
+	{
+		clear();
+	}
+
+	MIBIndex& MIBIndex::global()
+	{
+		static MIBIndex index;
+		return index;
+	}
+
+
+
+	bool MIBIndex::build(tree* head, uint64_t fingerprint)
+	{
+		std::vector<MIBNode> newNodes;
+		std::vector<MIBEnum> newEnums;
+		std::string pool(1, '\0');
+		std::unordered_map<std::string, uint32_t> offsets;
+		std::vector<tree*> sources;
+
+		auto intern = [&](const char* str) -> uint32_t
+		{
+			if(!str || !*str) return 0;
+			auto it = offsets.find(str);
+			if(it != offsets.end()) return it->second;
+
+			uint32_t offset = pool.size();
+			pool.append(str);
+			pool.push_back('\0');
+			offsets[str] = offset;
+			return offset;
+		};
+
+		// Appends a group of siblings, sorted by subid so lookups can use binary search
+		auto append = [&](std::vector<tree*>& group, uint32_t parent)
+		{
+			std::stable_sort(group.begin(), group.end(), [](const tree* t0, const tree* t1) { return t0->subid < t1->subid; });
+
+			uint32_t count = 0;
+			for(size_t i = 0; i < group.size(); i++)
+			{
+				// net-snmp resolves duplicates to the first node as well
+				if(i > 0 && group[i]->subid == group[i - 1]->subid)
+					continue;
+
+				tree* tr = group[i];
+				MIBNode node = {};
+				node.subid		= tr->subid;
+				node.parent		= parent;
+				node.firstChild	= 0;
+				node.childCount	= 0;
+				node.label		= intern(tr->label);
+				node.enums		= newEnums.size();
+				node.type		= tr->type;
+				node.access		= tr->access;
+				node.known		= find_module(tr->modid) ? 1 : 0;
+
+				for(enum_list* en = tr->enums; en; en = en->next)
+				{
+					newEnums.push_back({en->value, intern(en->label)});
+					node.enumCount++;
+				}
+
+				newNodes.push_back(node);
+				sources.push_back(tr);
+				count++;
+			}
+			return count;
+		};
+
+		std::vector<tree*> group;
+		for(tree* tr = head; tr; tr = tr->next_peer)
+			group.push_back(tr);
+		uint32_t roots = append(group, NONE);
+
+		// Breadth first, so all children of a node end up next to each other
+		for(size_t i = 0; i < newNodes.size(); i++)
+		{
+			group.clear();
+			for(tree* child = sources[i]->child_list; child; child = child->next_peer)
+				group.push_back(child);
+
+			uint32_t first = newNodes.size();
+			uint32_t count = append(group, i);
+			newNodes[i].firstChild	= first;
+			newNodes[i].childCount	= count;
+		}
+
+		MIBIndexHeader header = {};
+		memcpy(header.magic, MIB_INDEX_MAGIC, sizeof(header.magic));
+		header.version		= MIB_INDEX_VERSION;
+		header.nodeSize		= sizeof(MIBNode);
+		header.fingerprint	= fingerprint;
+		header.nodeCount	= newNodes.size();
+		header.enumCount	= newEnums.size();
+		header.stringSize	= pool.size();
+		header.rootCount	= roots;
+
+		std::vector<uint8_t> newBuffer(sizeof(header) + newNodes.size() * sizeof(MIBNode) + newEnums.size() * sizeof(MIBEnum) + pool.size());
+		uint8_t* out = newBuffer.data();
+		memcpy(out, &header, sizeof(header));										out += sizeof(header);
+		memcpy(out, newNodes.data(), newNodes.size() * sizeof(MIBNode));			out += newNodes.size() * sizeof(MIBNode);
+		memcpy(out, newEnums.data(), newEnums.size() * sizeof(MIBEnum));			out += newEnums.size() * sizeof(MIBEnum);
+		memcpy(out, pool.data(), pool.size());
+
+		clear();
+		buffer = std::move(newBuffer);
+		return attach(buffer.data(), buffer.size(), fingerprint);
+	}
+
+	bool MIBIndex::load(const std::filesystem::path& path, uint64_t fingerprint)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(MIBIndexHeader))
+		{
+			close(fd);
+			return false;
+		}
+
+		void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED)
+			return false;
+
+		clear();
+		mapped = true;
+		if(!attach((const uint8_t*) map, st.st_size, fingerprint))
+		{
+			clear();
+			return false;
+		}
+		return true;
+	}
+
+	bool MIBIndex::save(const std::filesystem::path& path) const
+	{
+		if(!data)
+			return false;
+
+		// Write to a temporary file first, so concurrent starts never map a partial index
+		std::filesystem::path tmp = path;
+		tmp += ".tmp";
+		{
+			std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+			if(!file.write((const char*) data, dataSize))
+				return false;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmp, path, ec);
+		return !ec;
+	}
+
+	void MIBIndex::clear()
+	{
+		if(mapped && data)
+			munmap((void*) data, dataSize);
+
+		buffer.clear();
+		data		= nullptr;
+		dataSize	= 0;
+		mapped		= false;
+
+		nodes		= nullptr;
+		enums		= nullptr;
+		strings		= nullptr;
+		nodeCount	= 0;
+		enumCount	= 0;
+		stringSize	= 0;
+		rootCount	= 0;
+
+		std::unique_lock<std::mutex> lock(labelMutex);
+		labels.clear();
+	}
+
+	/**
+	 * Checks the header and all references, a stale or damaged cache is never used
+	 */
+	bool MIBIndex::attach(const uint8_t* data, size_t size, uint64_t fingerprint)
+	{
+		this->data		= data;
+		this->dataSize	= size;
+
+		const MIBIndexHeader* header = (const MIBIndexHeader*) data;
+		if(memcmp(header->magic, MIB_INDEX_MAGIC, sizeof(header->magic)) != 0)	return false;
+		if(header->version != MIB_INDEX_VERSION)		return false;
+		if(header->nodeSize != sizeof(MIBNode))			return false;
+		if(header->fingerprint != fingerprint)			return false;
+
+		uint64_t expected = sizeof(MIBIndexHeader) + (uint64_t) header->nodeCount * sizeof(MIBNode) + (uint64_t) header->enumCount * sizeof(MIBEnum) + header->stringSize;
+		if(expected != size || header->stringSize == 0 || header->rootCount > header->nodeCount)
+			return false;
+
+		const MIBNode* newNodes	= (const MIBNode*) (data + sizeof(MIBIndexHeader));
+		const MIBEnum* newEnums	= (const MIBEnum*) (newNodes + header->nodeCount);
+		const char* newStrings	= (const char*) (newEnums + header->enumCount);
+		if(newStrings[header->stringSize - 1] != '\0')
+			return false;
+
+		for(uint32_t i = 0; i < header->nodeCount; i++)
+		{
+			const MIBNode& node = newNodes[i];
+			if(node.parent != NONE && node.parent >= i)											return false;
+			if(node.childCount > 0 && (node.firstChild <= i || (uint64_t) node.firstChild + node.childCount > header->nodeCount))	return false;
+			if((uint64_t) node.enums + node.enumCount > header->enumCount)						return false;
+			if(node.label >= header->stringSize)												return false;
+		}
+		for(uint32_t i = 0; i < header->enumCount; i++)
+		{
+			if(newEnums[i].label >= header->stringSize)
+				return false;
+		}
+
+		nodes		= newNodes;
+		enums		= newEnums;
+		strings		= newStrings;
+		nodeCount	= header->nodeCount;
+		enumCount	= header->enumCount;
+		stringSize	= header->stringSize;
+		rootCount	= header->rootCount;
+		return true;
+	}
+
+
+
+	const MIBNode* MIBIndex::search(uint32_t first, uint32_t count, uint32_t subid) const
+	{
+		const MIBNode* begin	= nodes + first;
+		const MIBNode* end		= begin + count;
+		const MIBNode* it = std::lower_bound(begin, end, subid, [](const MIBNode& node, uint32_t subid) { return node.subid < subid; });
+		if(it == end || it->subid != subid)
+			return nullptr;
+		return it;
+	}
+
+	const MIBNode* MIBIndex::find(const oid* name, size_t length) const
+	{
+		if(!nodes || length == 0)
+			return nullptr;
+
+		const MIBNode* node = nullptr;
+		uint32_t first = 0;
+		uint32_t count = rootCount;
+		for(size_t i = 0; i < length; i++)
+		{
+			if(name[i] > UINT32_MAX)
+				return nullptr;
+
+			node = search(first, count, name[i]);
+			if(!node)
+				return nullptr;
+
+			first = node->firstChild;
+			count = node->childCount;
+		}
+		return node;
+	}
+
+	const MIBNode* MIBIndex::findLabel(const std::string& label) const
+	{
+		if(!nodes)
+			return nullptr;
+
+		std::unique_lock<std::mutex> lock(labelMutex);
+		if(labels.empty())
+		{
+			// Nodes are ordered breadth first, so the label closest to the root wins
+			for(uint32_t i = 0; i < nodeCount; i++)
+				labels.emplace(strings + nodes[i].label, i);
+		}
+
+		auto it = labels.find(label);
+		if(it == labels.end())
+			return nullptr;
+		return nodes + it->second;
+	}
+
+	/**
+	 * Returns the deepest node on the path of name, e.g. the column of a table cell
+	 */
+	const MIBNode* MIBIndex::findClosest(const oid* name, size_t length) const
+	{
+		if(!nodes)
+			return nullptr;
+
+		const MIBNode* closest = nullptr;
+		uint32_t first = 0;
+		uint32_t count = rootCount;
+		for(size_t i = 0; i < length && name[i] <= UINT32_MAX; i++)
+		{
+			const MIBNode* node = search(first, count, name[i]);
+			if(!node)
+				break;
+
+			closest	= node;
+			first	= node->firstChild;
+			count	= node->childCount;
+		}
+		return closest;
+	}
+
+	/**
+	 * Resolves OIDs like sysUpTime.0, SNMPv2-MIB::sysUpTime.0 or iso.org.dod.3 without net-snmp having parsed the MIBs
+	 */
+	bool MIBIndex::parse(const std::string& raw, std::vector<oid>& oids) const
+	{
+		std::string name = raw;
+		size_t module = name.find("::");
+		if(module != std::string::npos)
+			name = name.substr(module + 2);
+
+		bool absolute = name.starts_with(".");
+		if(absolute)
+			name = name.substr(1);
+
+		oids.clear();
+		const MIBNode* current = nullptr;
+		for(const std::string& part : split(name, '.'))
+		{
+			if(part.empty())
+				return false;
+
+			char* end;
+			unsigned long number = strtoul(part.c_str(), &end, 10);
+			if(*end == '\0')
+			{
+				if(current)				current = getChild(current, number);
+				else if(oids.empty())	current = search(0, rootCount, number);
+				oids.push_back(number);
+				continue;
+			}
+
+			if(oids.empty() && !absolute)
+			{
+				// Leading label can be anywhere in the tree
+				current = findLabel(part);
+				if(!current)
+					return false;
+				oids = getOID(current);
+				continue;
+			}
+
+			// Following labels have to be children of the current node
+			const MIBNode* child = nullptr;
+			if(current)
+			{
+				const MIBNode* children = getChildren(current);
+				for(uint32_t i = 0; i < current->childCount && !child; i++)
+				{
+					if(part == getLabel(children + i))
+						child = children + i;
+				}
+			}
+			else if(oids.empty())
+			{
+				for(uint32_t i = 0; i < rootCount && !child; i++)
+				{
+					if(part == getLabel(nodes + i))
+						child = nodes + i;
+				}
+			}
+
+			if(!child)
+				return false;
+			oids.push_back(child->subid);
+			current = child;
+		}
+
+		return !oids.empty();
+	}
+
+
+
+	/**
+	 * Prepares a value for snmp_add_var the way net-snmp would with its MIB tree:
+	 * '=' is replaced by the type of the object and enum labels of integers by their value.
+	 * Returns SNMPERR_SUCCESS or the error snmp_add_var would report
+	 */
+	int MIBIndex::resolveValue(const oid* name, size_t length, char& type, std::string& data) const
+	{
+		const MIBNode* node = findClosest(name, length);
+		if(type == '=')
+		{
+			type = node ? snmp_mibtype2char(node->type) : '=';
+			if(type == '=')
+				return SNMPERR_VAR_TYPE;
+		}
+
+		if(type == 'i' && node && node->enumCount > 0)
+		{
+			char* end;
+			strtol(data.c_str(), &end, 10);
+			if(data.empty() || *end != '\0')
+			{
+				int32_t value;
+				if(!getEnumValue(node, data, value))
+					return SNMPERR_VALUE;
+				data = std::to_string(value);
+			}
+		}
+		return SNMPERR_SUCCESS;
+	}
+
+	/**
+	 * Called once net-snmp needs its own MIB tree after the index was loaded from the cache
+	 */
+	void MIBIndex::setTreeLoader(std::function<bool()> loader)
+	{
+		std::unique_lock<std::mutex> lock(treeMutex);
+		treeLoader = std::move(loader);
+	}
+
+	/**
+	 * Loads the MIBs into net-snmp for names only it can parse (e.g. quoted string indices).
+	 * Returns true if the tree was loaded by this call, so parsing again might succeed
+	 */
+	bool MIBIndex::requireTree()
+	{
+		std::unique_lock<std::mutex> lock(treeMutex);
+		if(!treeLoader)
+			return false;
+
+		std::function<bool()> loader = std::move(treeLoader);
+		treeLoader = nullptr;
+		return loader();
+	}
+
+
+
+	const MIBNode* MIBIndex::getParent(const MIBNode* node) const
+	{
+		if(node->parent == NONE)
+			return nullptr;
+		return nodes + node->parent;
+	}
+
+	const MIBNode* MIBIndex::getChildren(const MIBNode* node) const
+	{
+		return nodes + node->firstChild;
+	}
+
+	const MIBNode* MIBIndex::getChild(const MIBNode* node, uint32_t subid) const
+	{
+		return search(node->firstChild, node->childCount, subid);
+	}
+
+	const char* MIBIndex::getLabel(const MIBNode* node) const
+	{
+		return strings + node->label;
+	}
+
+	const char* MIBIndex::getEnumLabel(const MIBNode* node, int32_t value) const
+	{
+		for(uint32_t i = node->enums; i < node->enums + node->enumCount; i++)
+		{
+			if(enums[i].value == value)
+				return strings + enums[i].label;
+		}
+		return nullptr;
+	}
+
+	bool MIBIndex::getEnumValue(const MIBNode* node, const std::string& label, int32_t& value) const
+	{
+		for(uint32_t i = node->enums; i < node->enums + node->enumCount; i++)
+		{
+			if(label == strings + enums[i].label)
+			{
+				value = enums[i].value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<oid> MIBIndex::getOID(const MIBNode* node) const
+	{
+		std::vector<oid> ids;
+		for(const MIBNode* current = node; current; current = getParent(current))
+			ids.push_back(current->subid);
+		std::reverse(ids.begin(), ids.end());
+		return ids;
+	}
+
+
+
+	static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*) data;
+		for(size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001B3;
+		}
+		return hash;
+	}
+
+	static uint64_t fnv1a(uint64_t hash, const std::string& str)
+	{
+		// Terminator keeps consecutive strings apart
+		return fnv1a(hash, str.c_str(), str.size() + 1);
+	}
+
+	/**
+	 * Hashes path, modification time and size of all MIB files that would be read.
+	 * System MIBs are covered by the MIB directories of net-snmp and the MIBS/MIBDIRS environment.
+	 * The selection holds the OIDs MIB modules were loaded for, it is empty if all modules were loaded.
+	 */
+	uint64_t MIBIndex::fingerprint(const std::vector<std::filesystem::path>& files, bool system, const std::vector<std::string>& selection)
+	{
+		std::vector<std::filesystem::path> roots = files;
+		uint64_t hash = 0xCBF29CE484222325;
+		hash = fnv1a(hash, &MIB_INDEX_VERSION, sizeof(MIB_INDEX_VERSION));
+		hash = fnv1a(hash, &system, sizeof(system));
+
+		uint64_t selected = selection.size();
+		hash = fnv1a(hash, &selected, sizeof(selected));
+		for(const std::string& raw : selection)
+			hash = fnv1a(hash, raw);
+
+		if(system)
+		{
+			const char* mibs = getenv("MIBS");
+			const char* dirs = getenv("MIBDIRS");
+			hash = fnv1a(hash, mibs ? mibs : "");
+			hash = fnv1a(hash, dirs ? dirs : "");
+
+			const char* directories = netsnmp_get_mib_directory();
+			if(directories)
+			{
+				for(const std::string& dir : split(directories, ':'))
+					roots.emplace_back(dir);
+			}
+		}
+
+		std::vector<std::filesystem::path> paths;
+		for(const std::filesystem::path& root : roots)
+		{
+			std::error_code ec;
+			if(std::filesystem::is_directory(root, ec))
+			{
+				for(auto it = std::filesystem::recursive_directory_iterator(root, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+				{
+					if(it->is_regular_file(ec))
+						paths.push_back(it->path());
+				}
+			}
+			else
+			{
+				paths.push_back(root);
+			}
+		}
+
+		// Directory order is not stable
+		std::sort(paths.begin(), paths.end());
+		for(const std::filesystem::path& path : paths)
+		{
+			std::error_code ec;
+			int64_t mtime	= std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+			uint64_t size	= std::filesystem::file_size(path, ec);
+			if(ec) size = UINT64_MAX;
+
+			hash = fnv1a(hash, path.string());
+			hash = fnv1a(hash, &mtime, sizeof(mtime));
+			hash = fnv1a(hash, &size, sizeof(size));
+		}
+		return hash;
+	}
+
+}	// namespace snmpfs
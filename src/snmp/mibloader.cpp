@@ -0,0 +1,385 @@
+#include "snmp/mibloader.h"
+
+#include "core/util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+namespace snmpfs {
+
+	static const std::set<std::string> MIB_MACROS = {
+		"OBJECT-TYPE", "MODULE-IDENTITY", "OBJECT-IDENTITY", "NOTIFICATION-TYPE",
+		"OBJECT-GROUP", "NOTIFICATION-GROUP", "MODULE-COMPLIANCE", "AGENT-CAPABILITIES"
+	};
+
+	static bool isLabel(const std::string& token)
+	{
+		return !token.empty() && token[0] >= 'a' && token[0] <= 'z';
+	}
+
+	static bool isNumber(const std::string& token)
+	{
+		return !token.empty() && std::all_of(token.begin(), token.end(), ::isdigit);
+	}
+
+	/**
+	 * Splits ASN.1 text into identifiers, numbers and symbols, comments and strings are dropped
+	 */
+	static std::vector<std::string> tokenize(const std::string& text)
+	{
+		std::vector<std::string> tokens;
+		size_t n = text.size();
+		size_t i = 0;
+		while(i < n)
+		{
+			unsigned char c = text[i];
+			if(isspace(c))
+			{
+				i++;
+			}
+			else if(c == '-' && i + 1 < n && text[i + 1] == '-')
+			{
+				// Comments end at the line end or the next '--'
+				i += 2;
+				while(i < n && text[i] != '\n')
+				{
+					if(text[i] == '-' && i + 1 < n && text[i + 1] == '-')
+					{
+						i += 2;
+						break;
+					}
+					i++;
+				}
+			}
+			else if(c == '"')
+			{
+				i = text.find('"', i + 1);
+				i = i == std::string::npos ? n : i + 1;
+			}
+			else if(text.compare(i, 3, "::=") == 0)
+			{
+				tokens.emplace_back("::=");
+				i += 3;
+			}
+			else if(isalnum(c) || c == '_')
+			{
+				size_t j = i;
+				while(j < n && (isalnum((unsigned char) text[j]) || text[j] == '_' || (text[j] == '-' && j + 1 < n && text[j + 1] != '-')))
+					j++;
+				tokens.emplace_back(text.substr(i, j - i));
+				i = j;
+			}
+			else
+			{
+				tokens.emplace_back(1, c);
+				i++;
+			}
+		}
+		return tokens;
+	}
+
+
+
+	bool MIBLoader::scan(const std::filesystem::path& path)
+	{
+		if(!std::filesystem::exists(path))
+			return false;
+
+		scanPath(path, false);
+		return true;
+	}
+
+	/**
+	 * Scans the MIB directories of net-snmp, which replaces read_all_mibs
+	 */
+	void MIBLoader::scanSystem()
+	{
+		const char* directories = netsnmp_get_mib_directory();
+		if(!directories)
+			return;
+
+		for(const std::string& dir : split(directories, ':'))
+		{
+			std::error_code ec;
+			if(dir.empty() || !std::filesystem::is_directory(dir, ec))
+				continue;
+
+			// net-snmp does not descend into subdirectories of MIB directories
+			for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dir, ec))
+			{
+				if(entry.is_regular_file(ec))
+					scanFile(entry.path(), true);
+			}
+		}
+	}
+
+	void MIBLoader::scanPath(const std::filesystem::path& path, bool system)
+	{
+		if(!std::filesystem::is_directory(path))
+		{
+			scanFile(path, system);
+			return;
+		}
+
+		for(const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(path))
+		{
+			if(entry.is_regular_file())
+				scanFile(entry.path(), system);
+		}
+	}
+
+	void MIBLoader::scanFile(const std::filesystem::path& file, bool system)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		if(!stream)
+			return;
+		std::stringstream ss;
+		ss << stream.rdbuf();
+		std::vector<std::string> tokens = tokenize(ss.str());
+
+		int64_t current = -1;
+		for(size_t i = 0; i + 1 < tokens.size(); i++)
+		{
+			// Module header: <name> DEFINITIONS ::= BEGIN
+			if(tokens[i + 1] == "DEFINITIONS")
+			{
+				current = -1;
+				if(moduleIndex.contains(tokens[i]))
+					continue;
+
+				// First file providing a module wins, configured files are scanned first
+				current = modules.size();
+				moduleIndex[tokens[i]] = current;
+				modules.push_back({tokens[i], file, {}, system});
+				continue;
+			}
+
+			if(current < 0)
+				continue;
+
+			// IMPORTS <symbols> FROM <module> ... ;
+			if(tokens[i] == "IMPORTS")
+			{
+				for(i++; i < tokens.size() && tokens[i] != ";"; i++)
+				{
+					if(tokens[i] == "FROM" && i + 1 < tokens.size())
+						modules[current].imports.push_back(tokens[++i]);
+				}
+				continue;
+			}
+
+			// <label> OBJECT IDENTIFIER ::= { ... } or <label> <MACRO> ... ::= { ... }
+			if(!isLabel(tokens[i]))
+				continue;
+			bool identifier = tokens[i + 1] == "OBJECT" && i + 3 < tokens.size() && tokens[i + 2] == "IDENTIFIER" && tokens[i + 3] == "::=";
+			if(!identifier && !MIB_MACROS.contains(tokens[i + 1]))
+				continue;
+
+			size_t assign = std::find(tokens.begin() + i + 1, tokens.end(), "::=") - tokens.begin();
+			if(assign + 1 >= tokens.size() || tokens[assign + 1] != "{")
+				continue;
+
+			Definition definition;
+			definition.module = current;
+			bool valid = true;
+			size_t j = assign + 2;
+			for(; j < tokens.size() && tokens[j] != "}"; j++)
+			{
+				if(isNumber(tokens[j]))
+				{
+					definition.subids.push_back(strtoul(tokens[j].c_str(), nullptr, 10));
+				}
+				else if(j + 3 < tokens.size() && tokens[j + 1] == "(" && isNumber(tokens[j + 2]) && tokens[j + 3] == ")")
+				{
+					// Named number like org(3)
+					definition.subids.push_back(strtoul(tokens[j + 2].c_str(), nullptr, 10));
+					j += 3;
+				}
+				else if(j == assign + 2)
+				{
+					definition.parent = tokens[j];
+				}
+				else
+				{
+					valid = false;
+				}
+			}
+
+			if(valid && !definition.subids.empty())
+				definitions[tokens[i]].push_back(definition);
+			i = j;
+		}
+	}
+
+
+
+	bool MIBLoader::resolve(const std::string& label, std::vector<uint32_t>& oids, uint32_t depth)
+	{
+		auto it = resolved.find(label);
+		if(it != resolved.end())
+		{
+			oids = it->second;
+			return true;
+		}
+
+		if(label == "ccitt")			{ oids = {0}; return true; }
+		if(label == "iso")				{ oids = {1}; return true; }
+		if(label == "joint-iso-ccitt")	{ oids = {2}; return true; }
+
+		// Guards against cyclic definitions
+		auto defs = definitions.find(label);
+		if(defs == definitions.end() || depth > 128)
+			return false;
+
+		for(const Definition& definition : defs->second)
+		{
+			std::vector<uint32_t> base;
+			if(!definition.parent.empty() && !resolve(definition.parent, base, depth + 1))
+				continue;
+
+			base.insert(base.end(), definition.subids.begin(), definition.subids.end());
+			resolved[label] = base;
+			oids = base;
+			return true;
+		}
+		return false;
+	}
+
+	void MIBLoader::index()
+	{
+		for(const auto& [label, defs] : definitions)
+		{
+			for(const Definition& definition : defs)
+			{
+				std::vector<uint32_t> oids;
+				if(!definition.parent.empty() && !resolve(definition.parent, oids, 0))
+					continue;
+
+				oids.insert(oids.end(), definition.subids.begin(), definition.subids.end());
+				owners[oids].push_back(definition.module);
+			}
+		}
+		indexed = true;
+	}
+
+	void MIBLoader::requireModule(uint32_t module)
+	{
+		if(!required.insert(module).second)
+			return;
+
+		for(const std::string& import : modules[module].imports)
+		{
+			auto it = moduleIndex.find(import);
+			if(it != moduleIndex.end())
+				requireModule(it->second);
+		}
+	}
+
+	/**
+	 * Marks all modules defining the OID, its ancestors or its descendants as required.
+	 * Returns false if a label of the OID is not defined by any scanned module.
+	 */
+	bool MIBLoader::require(const std::string& raw)
+	{
+		if(!indexed)
+			index();
+
+		std::string name = raw;
+		size_t separator = name.find("::");
+		if(separator != std::string::npos)
+		{
+			auto it = moduleIndex.find(name.substr(0, separator));
+			if(it != moduleIndex.end())
+				requireModule(it->second);
+			name = name.substr(separator + 2);
+		}
+		if(name.starts_with("."))
+			name = name.substr(1);
+
+		std::vector<uint32_t> oids;
+		for(const std::string& part : split(name, '.'))
+		{
+			if(isNumber(part))
+			{
+				oids.push_back(strtoul(part.c_str(), nullptr, 10));
+				continue;
+			}
+
+			std::vector<uint32_t> labelOIDs;
+			if(!resolve(part, labelOIDs, 0))
+				return false;
+
+			// Labels after the first one have to name a child
+			if(!oids.empty() && (labelOIDs.size() != oids.size() + 1 || !std::equal(oids.begin(), oids.end(), labelOIDs.begin())))
+				return false;
+			oids = labelOIDs;
+		}
+		if(oids.empty())
+			return false;
+
+		for(size_t length = 1; length <= oids.size(); length++)
+		{
+			auto it = owners.find(std::vector<uint32_t>(oids.begin(), oids.begin() + length));
+			if(it == owners.end())
+				continue;
+			for(uint32_t module : it->second)
+				requireModule(module);
+		}
+
+		// Trees and tables need everything below them
+		for(auto it = owners.upper_bound(oids); it != owners.end(); it++)
+		{
+			if(it->first.size() <= oids.size() || !std::equal(oids.begin(), oids.end(), it->first.begin()))
+				break;
+			for(uint32_t module : it->second)
+				requireModule(module);
+		}
+		return true;
+	}
+
+	/**
+	 * Loads the required modules, imported modules before the modules importing them
+	 */
+	bool MIBLoader::load() const
+	{
+		std::vector<uint32_t> order;
+		std::set<uint32_t> visited;
+		std::function<void(uint32_t)> visit = [&](uint32_t module)
+		{
+			if(!visited.insert(module).second)
+				return;
+			for(const std::string& import : modules[module].imports)
+			{
+				auto it = moduleIndex.find(import);
+				if(it != moduleIndex.end() && required.contains(it->second))
+					visit(it->second);
+			}
+			order.push_back(module);
+		};
+		for(uint32_t module : required)
+			visit(module);
+
+		for(uint32_t module : order)
+		{
+			const Module& mod = modules[module];
+			if(mod.system)
+			{
+				// net-snmp knows system modules by name, unparsable ones are skipped like read_all_mibs does
+				if(!read_module(mod.name.c_str()))
+					printf("Error loading MIB module %s\n", mod.name.c_str());
+				continue;
+			}
+
+			if(!read_mib(mod.file.c_str()))
+			{
+				printf("Error loading MIB from %s\n", mod.file.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+}	// namespace snmpfs
@@ -1,5 +1,6 @@
 #include "snmp/object.h"
 
+#include "core/taskmanager.h"
 #include "snmp/device.h"
 #include <algorithm>
 
@@ -12,12 +13,14 @@ namespace snmpfs {
 
 	Object::Object(Device* device, ObjectID id, char type) : device(device), id(id), type(type)
 	{
-
+		lastRead = TaskManager::now();
 	}
 
 	Object::Object(Device* device, ObjectID id, const ObjectData& data) : device(device), id(id), type(data.type)
 	{
 		this->data = data.data;
+		lastRead	= TaskManager::now();
+		lastUpdate	= lastRead.load();
 	}
 
 	Object::~Object()
@@ -66,6 +69,120 @@ namespace snmpfs {
 		}
 	}
 
+	void Object::touch()
+	{
+		lastRead = TaskManager::now();
+	}
+
+	uint64_t Object::getLastRead() const
+	{
+		return lastRead;
+	}
+
+	bool Object::park(uint64_t idleTime)
+	{
+		if(!parked && TaskManager::now() - lastRead >= idleTime)
+		{
+			parked = true;
+			device->logInfo("Parking object " + ((std::string) id) + " because it was not read");
+		}
+		return parked;
+	}
+
+	bool Object::wake()
+	{
+		if(!parked.exchange(false)) return false;
+		device->logInfo("Waking object " + ((std::string) id));
+		return true;
+	}
+
+	bool Object::isParked() const
+	{
+		return parked;
+	}
+
+	/**
+	 * Calls update unless another thread is already updating this object,
+	 * in that case waits for it to finish and returns its result
+	 */
+	bool Object::refresh()
+	{
+		std::unique_lock<std::mutex> lock(refreshMutex);
+		if(refreshing)
+		{
+			uint64_t count = refreshCount;
+			refreshDone.wait(lock, [&]{ return refreshCount != count; });
+			return refreshResult;
+		}
+
+		refreshing = true;
+		lock.unlock();
+
+		bool result = update();
+		if(result) lastUpdate = TaskManager::now();
+
+		lock.lock();
+		refreshing		= false;
+		refreshResult	= result;
+		refreshCount++;
+		refreshDone.notify_all();
+		return result;
+	}
+
+	bool Object::isStale() const
+	{
+		return maxAge && TaskManager::now() - lastUpdate >= maxAge;
+	}
+
+	uint64_t Object::getMaxAge() const
+	{
+		return maxAge;
+	}
+
+	void Object::setMaxAge(uint64_t maxAge)
+	{
+		this->maxAge = maxAge;
+	}
+
+	uint32_t Object::getInterval() const
+	{
+		return interval;
+	}
+
+	uint32_t Object::getBaseInterval() const
+	{
+		return baseInterval;
+	}
+
+	void Object::setInterval(uint32_t interval)
+	{
+		this->baseInterval	= interval;
+		this->interval		= interval;
+	}
+
+	void Object::setIntervalBounds(uint32_t minInterval, uint32_t maxInterval)
+	{
+		this->minInterval	= minInterval;
+		this->maxInterval	= maxInterval;
+		adaptedChangeCount	= changeCount;
+	}
+
+	bool Object::isAdaptive() const
+	{
+		return minInterval < maxInterval;
+	}
+
+	uint32_t Object::adapt()
+	{
+		uint64_t changes = changeCount;
+		bool changed = changes != adaptedChangeCount;
+		adaptedChangeCount = changes;
+
+		uint32_t next = changed ? interval / 2 : interval * 2;
+		interval = std::clamp(next, minInterval, maxInterval);
+		return interval;
+	}
+
 	std::string Object::getData() const
 	{
 		return data;
@@ -165,6 +282,8 @@ namespace snmpfs {
 
 	void Object::notifyChanged(bool restore) const
 	{
+		if(!restore) changeCount++;
+
 		std::unique_lock<std::mutex> lock(observerMutex);
 		for(ObjectObserver* observer : observers)
 		{
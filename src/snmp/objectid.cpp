@@ -1,5 +1,6 @@
 #include "snmp/objectid.h"
 
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 
@@ -125,33 +126,36 @@ namespace snmpfs {
 		return true;
 	}
 
-	tree* ObjectID::toMIB(const ObjectID& id)
+	/**
+	 * Returns the number of leading arcs both OIDs have in common
+	 */
+	size_t ObjectID::commonLength(const ObjectID& other) const
 	{
-		// Retrieve MIB tree node via SNMP
-		tree* tr = get_tree(id, id, get_tree_head());
-		if(!tr)
-		{
-			return nullptr;
-		}
+		size_t common = 0;
+		while(common < oids.size() && common < other.oids.size() && oids[common] == other.oids[common])
+			common++;
+		return common;
+	}
 
-		// Retrieve OID of tree node we found
-		tree* current = tr;
-		std::vector<oid> ids;
-		while(current)
-		{
-			ids.insert(ids.begin(), current->subid);
-			current = current->parent;
-		}
+	ObjectID ObjectID::getPrefix(size_t length) const
+	{
+		return ObjectID(std::vector<oid>(oids.begin(), oids.begin() + std::min(length, oids.size())));
+	}
 
-		// Check if they are equal (then table entry was found)
-		if(ids == id.oids)
-			return tr;
+	const MIBNode* ObjectID::toMIB(const ObjectID& id)
+	{
+		const MIBIndex& index = MIBIndex::global();
+
+		// Exact match (then table entry was found)
+		const MIBNode* node = index.find(id, id);
+		if(node)
+			return node;
 
-		// Check if they are equal (then scalar entry was found)
+		// Check parent (then scalar entry was found)
 		// This has to be done since we always store the OID with a trailing .0
 		// But MIB entries only contain the number without it
-		if(id.back() == 0 && ids == id.getParentID().oids)
-			return tr;
+		if(id.length() > 1 && id.back() == 0)
+			return index.find(id, id.length() - 1);
 
 		return nullptr;
 	}
@@ -170,11 +174,26 @@ namespace snmpfs {
 
 	void ObjectID::set(const char* raw)
 	{
+		// The index knows the same MIBs whether it was built or loaded from the cache
+		std::vector<oid> parsed;
+		if(MIBIndex::global().parse(raw, parsed))
+		{
+			set(parsed);
+			return;
+		}
+
+		// Only net-snmp parses some forms (e.g. quoted string indices), it needs its tree for them
 		oid name[MAX_OID_LEN];
 		size_t name_length = MAX_OID_LEN;	// MUST BE SET TO MAX_OID_LEN
 
 		oid* res = snmp_parse_oid(raw, name, &name_length);
-		if(!res) throw std::runtime_error("Could not parse OID from " + std::string(raw));
+		if(!res && MIBIndex::global().requireTree())
+		{
+			name_length = MAX_OID_LEN;
+			res = snmp_parse_oid(raw, name, &name_length);
+		}
+		if(!res)
+			throw std::runtime_error("Could not parse OID from " + std::string(raw));
 
 		set(name, name_length);
 	}
@@ -201,7 +220,7 @@ namespace snmpfs {
 	{
 		mib = toMIB(*this);
 
-		if(mib && find_module(mib->modid))
+		if(mib && mib->known)
 		{
 			// FOUND MIB INFO
 			mibAvailable	= true;
@@ -65,6 +65,43 @@ namespace snmpfs {
 	}
 
 
+	/**
+	 * Maps TYPE_* of a MIB node to the type snmp_add_var uses for it, like net-snmp does for '='
+	 */
+	char snmp_mibtype2char(u_char type)
+	{
+		switch(type)
+		{
+			case TYPE_INTEGER:
+			case TYPE_INTEGER32:	return 'i';
+			case TYPE_GAUGE:
+			case TYPE_UNSIGNED32:	return 'u';
+			case TYPE_UINTEGER:		return '3';
+			case TYPE_COUNTER:		return 'c';
+			case TYPE_COUNTER64:	return 'C';
+			case TYPE_TIMETICKS:	return 't';
+			case TYPE_OCTETSTR:		return 's';
+			case TYPE_BITSTRING:	return 'b';
+			case TYPE_IPADDR:		return 'a';
+			case TYPE_OBJID:		return 'o';
+
+			default:	return '=';
+		}
+	}
+
+	/**
+	 * Stops net-snmp from consulting its own MIB tree where snmpfs uses the MIBIndex,
+	 * the tree is empty if the index was loaded from the cache
+	 */
+	void snmp_use_mib_index()
+	{
+		// Values are checked against the MIB by MIBIndex::resolveValue and by the agent
+		netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DONT_CHECK_RANGE, true);
+
+		// Labels of OID values would depend on the loaded modules
+		netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT, NETSNMP_OID_OUTPUT_NUMERIC);
+	}
+
 
 	void snmp_syslog_err(snmp_session* session)
 	{
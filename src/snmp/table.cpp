@@ -1,10 +1,12 @@
 #include "snmp/table.h"
 
 #include "core/csv.h"
+#include "core/taskmanager.h"
 #include "core/util.h"
 #include "snmp/device.h"
 
 #include <algorithm>
+#include <charconv>
 #include <sstream>
 
 namespace snmpfs {
@@ -17,19 +19,17 @@ namespace snmpfs {
 
 	Table::~Table()
 	{
-		// Free all rowData
-		for(const auto& [colID, colData] : cells)
-		{
-			for(const auto& [rowID, cell] : colData)
-			{
-				delete cell;
-			}
-		}
+
 	}
 
 	void Table::addColumn(std::string name, ObjectID oid)
 	{
-		columns.push_back({name, oid});
+		TableColumn column;
+		column.name		= name;
+		column.oid		= oid;
+		column.lastRead	= TaskManager::now();	// columns are polled until they were unread for a while
+		columns.push_back(column);
+		layoutValid = false;
 	}
 
 	ObjectID Table::getColumnOID(const std::string& name) const
@@ -47,6 +47,7 @@ namespace snmpfs {
 	void Table::reverseColumns()
 	{
 		std::reverse(columns.begin(), columns.end());
+		layoutValid = false;
 	}
 
 	bool Table::isReadable() const
@@ -70,130 +71,393 @@ namespace snmpfs {
 
 	std::string Table::getData() const
 	{
-		// std::unique_lock<std::mutex> lock(tableLock);
-		std::stringstream ss;
+		std::unique_lock<std::mutex> lock(tableMutex);
+		render();
+		return csvCache;
+	}
 
-		// WRITE TABLE HEADER
-		for(size_t i = 0; i < columns.size(); i++)
-		{
-			const TableColumn& col = columns[i];
-			ss << col.name;
 
-			if(i < columns.size() - 1)	ss << colSeparator;
-			// else						ss << rowSeparator;
-		}
-		ss << rowSeparator;
 
-		const std::set<std::string> rowSet = getRowIDs();
-		const std::vector<std::string> rows(rowSet.begin(), rowSet.end());
-		for(size_t r = 0; r < rows.size(); r++)
+	bool Table::updateData(const ObjectID& oid, const std::string& data)
+	{
+		// printf("[Table] UPDATING CELL DATA FOR %s (%s)\n", ((std::string) oid).c_str(), data.c_str());
+		bool changed = false;
 		{
-			const std::string& rowID = rows[r];
-			for(size_t c = 0; c < columns.size(); c++)
-			{
-				const TableColumn& col = columns[c];
-				if(!cells.contains(col.oid))
-				{
-					ss << "";
-				}
-				else if(!cells.at(col.oid).contains(rowID))
-				{
-					ss << "";
-				}
-				else
-				{
-					Object* cell = cells.at(col.oid).at(rowID);
-					ss << cell->getData();
-				}
+			std::unique_lock<std::mutex> lock(tableMutex);
 
-				if(c < columns.size() - 1)	ss << colSeparator;
-				// else						ss << rowSeparator;
-			}
-			if(r < rows.size() - 1)			ss << rowSeparator;
+			size_t c = 0;
+			while(c < columns.size() && !(columns[c].oid.length() < oid.length() && columns[c].oid.isAncestorOf(oid)))
+				c++;
+			if(c == columns.size()) return false;
+
+			// Only cells of known rows are updated, new rows appear with the next update
+			const size_t prefix = columns[c].oid.length();
+			const ::oid* cell = oid;
+			size_t row = findRow(cell + prefix, oid.length() - prefix);
+			if(row == rows.size()) return false;
+
+			changed = setCell(c, row, data);
 		}
 
-		return ss.str();
+		if(changed) notifyChanged();
+		return changed;
+	}
+
+	bool Table::dump() const
+	{
+		printf("---------- TABLE DUMP ----------\n");
+		printf("%s\n", getData().c_str());
+		printf("--------------------------------\n");
+		return true;
 	}
 
+	/**
+	 * Renders the row indices with the values of a single column, cached until the column changes
+	 */
+	std::string Table::getColumnData(const std::string& column) const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
 
+		size_t c = findColumn(column);
+		if(c == columns.size()) return "";
 
-	bool Table::updateData(const ObjectID& oid, const std::string& data)
+		renderColumn(c);
+		return columns[c].cache;
+	}
+
+	/**
+	 * Size of getColumnData without copying the projection
+	 */
+	size_t Table::getColumnSize(const std::string& column) const
 	{
-		// printf("[Table] UPDATING CELL DATA FOR %s (%s)\n", ((std::string) oid).c_str(), data.c_str());
-		for(auto& [colID, colData] : cells)
+		std::unique_lock<std::mutex> lock(tableMutex);
+
+		size_t c = findColumn(column);
+		if(c == columns.size()) return 0;
+
+		renderColumn(c);
+		return columns[c].cache.size();
+	}
+
+	/**
+	 * Renders the projection of a column if it changed, tableMutex has to be held
+	 */
+	void Table::renderColumn(size_t c) const
+	{
+		const TableColumn& col = columns[c];
+		if(!col.cacheValid)
 		{
-			if(!colID.isAncestorOf(oid)) continue;
+			col.cache.clear();
+			col.cache += "index";
+			col.cache += colSeparator;
+			col.cache += col.name;
 
-			for(auto& [rowID, cell] : colData)
+			for(size_t r = 0; r < rows.size(); r++)
 			{
-				if(cell->getID() == oid)
+				col.cache += rowSeparator;
+				for(uint32_t i = 0; i < rows[r].length; i++)
 				{
-					return cell->updateData(oid, data);
+					if(i > 0) col.cache += '.';
+					col.cache += std::to_string(indexArena[rows[r].offset + i]);
 				}
+				col.cache += colSeparator;
+				appendCell(col.cache, c, r);
 			}
+			col.cacheValid = true;
 		}
-		throw std::runtime_error("NO CELL FOUND!");
 	}
 
-	bool Table::dump() const
+	/**
+	 * Renders the header and all rows whose cell in the given column equals value
+	 */
+	std::string Table::getMatchingRows(const std::string& column, const std::string& value) const
 	{
-		printf("---------- TABLE DUMP ----------\n");
-		printf("%s\n", getData().c_str());
-		printf("--------------------------------\n");
+		std::unique_lock<std::mutex> lock(tableMutex);
+
+		size_t c = findColumn(column);
+		if(c == columns.size()) return "";
+
+		const TableColumn& col = columns[c];
+		if(!col.indexed) buildValueIndex(c);
+		render();
+
+		// Header is everything before the first row
+		std::string out = csvCache.substr(0, rows.empty() ? csvCache.size() : rowSpans[0].offset);
+		if(!rows.empty()) out.pop_back();
+
+		auto it = col.valueIndex.find(value);
+		if(it == col.valueIndex.end()) return out;
+
+		for(const TableIndex& index : it->second)
+		{
+			size_t row = findRow(index.data(), index.size());
+			if(row == rows.size()) continue;
+
+			out += rowSeparator;
+			out.append(csvCache, rowSpans[row].offset, rowSpans[row].length);
+		}
+
+		return out;
+	}
+
+	/**
+	 * Size of getMatchingRows without building the result
+	 */
+	size_t Table::getMatchingSize(const std::string& column, const std::string& value) const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+
+		size_t c = findColumn(column);
+		if(c == columns.size()) return 0;
+
+		const TableColumn& col = columns[c];
+		if(!col.indexed) buildValueIndex(c);
+		render();
+
+		size_t size = rows.empty() ? csvCache.size() : rowSpans[0].offset - 1;
+
+		auto it = col.valueIndex.find(value);
+		if(it == col.valueIndex.end()) return size;
+
+		for(const TableIndex& index : it->second)
+		{
+			size_t row = findRow(index.data(), index.size());
+			if(row == rows.size()) continue;
+
+			size += 1 + rowSpans[row].length;
+		}
+
+		return size;
+	}
+
+	std::vector<std::string> Table::getColumnNames() const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+		std::vector<std::string> names;
+		for(const TableColumn& column : columns)
+			names.push_back(column.name);
+		return names;
+	}
+
+	std::vector<TableIndex> Table::getRowIndices() const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+		std::vector<TableIndex> indices;
+		indices.reserve(rows.size());
+		for(size_t r = 0; r < rows.size(); r++)
+			indices.emplace_back(getRowIndex(r));
+		return indices;
+	}
+
+	bool Table::hasRow(const TableIndex& index) const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+		return findRow(index.data(), index.size()) < rows.size();
+	}
+
+	/**
+	 * Changes with every update, rows might have been removed if it differs
+	 */
+	uint32_t Table::getGeneration() const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+		return generation;
+	}
+
+	/**
+	 * Reads a single cell without rendering the table, returns false if row or column do not exist
+	 */
+	bool Table::getCellData(const TableIndex& index, const std::string& column, std::string& data) const
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+
+		size_t c = findColumn(column);
+		if(c == columns.size()) return false;
+
+		size_t row = findRow(index.data(), index.size());
+		if(row == rows.size()) return false;
+
+		data.clear();
+		appendCell(data, c, row);
 		return true;
 	}
 
+	/**
+	 * Reading the whole table counts as read for every column
+	 */
+	void Table::touch()
+	{
+		Object::touch();
+
+		std::unique_lock<std::mutex> lock(tableMutex);
+		for(TableColumn& column : columns)
+			resume(column);
+	}
+
+	void Table::touchColumn(const std::string& column)
+	{
+		Object::touch();
+
+		std::unique_lock<std::mutex> lock(tableMutex);
+		size_t c = findColumn(column);
+		if(c < columns.size()) resume(columns[c]);
+	}
+
+	/**
+	 * Records the read, columns skipped by the last update hold outdated cells until they are walked again
+	 */
+	void Table::resume(TableColumn& column)
+	{
+		const uint64_t now = lastRead;
+		if(skipUnread && now > column.lastRead + skipUnread)
+			column.resumed = true;
+		column.lastRead = now;
+	}
+
+	/**
+	 * Also stale while a column that was skipped is read again, so opening it refreshes the Table first
+	 */
+	bool Table::isStale() const
+	{
+		if(Object::isStale()) return true;
+
+		std::unique_lock<std::mutex> lock(tableMutex);
+		for(const TableColumn& column : columns)
+		{
+			if(column.resumed) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Columns that were not read for idleTime ms are skipped by update (0 disables skipping)
+	 */
+	void Table::setSkipUnread(uint64_t idleTime)
+	{
+		std::unique_lock<std::mutex> lock(tableMutex);
+		skipUnread = idleTime;
+	}
+
+	/**
+	 * Parses a row index in the form used by formatIndex (e.g. 1 or 192.168.0.1)
+	 */
+	bool Table::parseIndex(const std::string& raw, TableIndex& index)
+	{
+		index.clear();
+		const char* current	= raw.data();
+		const char* end		= current + raw.size();
+		while(current < end)
+		{
+			oid arc;
+			auto res = std::from_chars(current, end, arc);
+			if(res.ec != std::errc()) return false;
+			index.push_back(arc);
+
+			current = res.ptr;
+			if(current == end) break;
+			if(*current != '.' || current + 1 == end) return false;
+			current++;
+		}
+
+		// Only accept the canonical form so every row has a single name
+		return !index.empty() && formatIndex(index) == raw;
+	}
+
+	std::string Table::formatIndex(const TableIndex& index)
+	{
+		std::string out;
+		for(size_t i = 0; i < index.size(); i++)
+		{
+			if(i > 0) out += '.';
+			out += std::to_string(index[i]);
+		}
+		return out;
+	}
+
 	bool Table::update()
 	{
-		// std::unique_lock<std::mutex> lock(tableLock);
 		// printf("[Table] Update %s from Device\n", ((std::string) id).c_str());
-		if(columns.size() <= 0) return false;
+		uint32_t current;
+		std::vector<std::pair<size_t, ObjectID>> polled;		///< column and its OID, copied while locked
+		{
+			std::unique_lock<std::mutex> lock(tableMutex);
+			if(columns.size() <= 0) return false;
+			current = ++generation;
+
+			// Skip columns nobody reads
+			const uint64_t now = TaskManager::now();
+			bool anyDense = false;
+			for(size_t c = 0; c < columns.size(); c++)
+			{
+				if(!skipUnread || now - columns[c].lastRead <= skipUnread)
+				{
+					polled.emplace_back(c, columns[c].oid);
+					anyDense |= columns[c].dense;
+				}
+			}
+
+			// Rows are only swept if a column having a cell in every row was walked, otherwise all columns are walked
+			if(!anyDense && polled.size() < columns.size())
+			{
+				auto dense = std::find_if(columns.begin(), columns.end(), [](const TableColumn& column) { return column.dense; });
+				if(dense != columns.end())
+				{
+					polled.emplace_back(dense - columns.begin(), dense->oid);
+				}
+				else
+				{
+					polled.clear();
+					for(size_t c = 0; c < columns.size(); c++)
+						polled.emplace_back(c, columns[c].oid);
+				}
+			}
 
+			for(const auto& [c, colOID] : polled)
+				columns[c].resumed = false;
+		}
 
-		std::set<std::string> rowIDs;
 		bool somethingChanged = false;
-		for(size_t c = 0; c < columns.size(); c++)
+		std::vector<size_t> cells(polled.size(), 0);		///< cells seen per polled column
+		for(size_t p = 0; p < polled.size(); p++)
 		{
-			const TableColumn& col = columns[c];
-			ObjectID currentOID	= col.oid;
+			const auto& [c, colOID] = polled[p];
+			ObjectID currentOID	= colOID;
 			ObjectData currentData;
+			size_t cursor = 0;		// rows are walked in order, so the next cell is usually in the following row
 			while(device->next(currentOID, currentData))
 			{
-				if(!col.oid.isAncestorOf(currentOID)) break;
+				if(!colOID.isAncestorOf(currentOID)) break;
 
-				std::string rowID = makeRowID(col.oid, currentOID);
-				rowIDs.emplace(rowID);
+				const oid* index		= ((oid*) currentOID) + colOID.length();
+				const size_t length		= currentOID.length() - colOID.length();
 
-				if(!cells[col.oid].contains(rowID))
+				// Only lock while applying, readers must not wait for the walk
+				std::unique_lock<std::mutex> lock(tableMutex);
+				size_t row = findRow(index, length, cursor);
+				if(row == rows.size())
 				{
 					// NEW ROW
-					Object* cell = new Object(device, currentData.id, currentData.type);
-					cells[col.oid][rowID] = cell;
+					row = insertRow(index, length);
 				}
+				rowGeneration[row] = current;
+				cursor = row + 1;
+				cells[p]++;
 
 				// UPDATE DATA
-				somethingChanged |= updateData(currentOID, currentData.data);
-			}
-		}
-
-		// Find rows that are not there anymore
-		std::vector<std::string> forRemoval;
-		for(const auto& [colID, colData] : cells)
-		{
-			for(const auto& [rowID, cell] : colData)
-			{
-				if(std::find(rowIDs.begin(), rowIDs.end(), rowID) == rowIDs.end())
-				{
-					forRemoval.push_back(rowID);
-				}
+				columns[c].type = currentData.type;
+				somethingChanged |= setCell(c, row, currentData.data);
 			}
 		}
 
 		// Delete rows that are not there anymore
-		for(const std::string& rowID : forRemoval)
 		{
-			removeRow(rowID);
-			somethingChanged |= true;
+			std::unique_lock<std::mutex> lock(tableMutex);
+			size_t seen = std::count(rowGeneration.begin(), rowGeneration.end(), current);
+			for(size_t p = 0; p < polled.size(); p++)
+				columns[polled[p].first].dense = cells[p] == seen;
+
+			somethingChanged |= sweepRows();
+			compactArena();
 		}
 
 		if(somethingChanged) notifyChanged();
@@ -205,7 +469,6 @@ namespace snmpfs {
 
 	bool Table::updateData(const std::string& data)
 	{
-		// std::unique_lock<std::mutex> lock(tableLock);
 		// printf("[Table] Update %s with:\n%s\n", ((std::string) id).c_str(), data.c_str());
 
 		try
@@ -213,45 +476,78 @@ namespace snmpfs {
 			bool allSuccess = true;
 			csvData csv = csvData::of(data, colSeparator, rowSeparator);
 
-			// Build helping structure to quickly map column ID to ObjectID
-			std::vector<ObjectID> columnOIDs;
+			// Build helping structure to quickly map CSV column to Table column
+			std::vector<size_t> columnIndices;
 			for(const std::string& name : csv.getRow(0))
 			{
-				ObjectID id = getColumnOID(name);
-				if(id == ObjectID()) throw std::runtime_error("No OID found for column " + name);
-				columnOIDs.emplace_back(id);
+				size_t c = findColumn(name);
+				if(c == columns.size()) throw std::runtime_error("No OID found for column " + name);
+				columnIndices.emplace_back(c);
 			}
 
-			// Build helping structure to quickly map rowID to OID
-			std::set<std::string> rowIDset = getRowIDs();
-			std::vector row2oid(rowIDset.begin(), rowIDset.end());
+			// Collect cells that differ from the current data (rows are mapped by position)
+			struct CellWrite {
+				size_t column;
+				TableIndex index;
+				std::string data;
+				char type;
+			};
+			std::vector<CellWrite> writes;
+			{
+				std::unique_lock<std::mutex> lock(tableMutex);
+				for(size_t row = 1; row < csv.getRowCount(); row++)
+				{
+					if(row - 1 >= rows.size()) throw std::runtime_error("Row not found in Table");
 
+					for(uint32_t column = 0; column < csv.getColumnCount(); column++)
+					{
+						const std::string& cellData = csv.get(row, column);
+						size_t c = columnIndices[column];
+						if(getCell(c, row - 1) != cellData)
+							writes.push_back({c, getRowIndex(row - 1), cellData, columns[c].type});
+					}
+				}
+			}
 
-			for(size_t row = 1; row < csv.getRowCount(); row++)
+			if(writes.empty())
 			{
-				std::string rowID = row2oid[row - 1];
-				for(uint32_t column = 0; column < csv.getColumnCount(); column++)
-				{
-					const std::string& cellData = csv.get(row, column);
-					const ObjectID colID = columnOIDs[column];
-					const ObjectID cellID(((std::string) colID) + rowID);
+				notifyChanged();
+				return true;
+			}
 
-					Object* obj = cells[colID][rowID];
-					if(obj)
+			// Send all changed cells together, the Device splits them if the agent requires it
+			std::vector<ObjectData> requests;
+			for(const CellWrite& write : writes)
+			{
+				ObjectData request = {};
+				request.id		= getCellOID(write.column, write.index);
+				request.type	= write.type;
+				request.data	= write.data;
+				requests.emplace_back(request);
+			}
+
+			std::vector<ObjectData> responses = device->set(requests);
+			{
+				std::unique_lock<std::mutex> lock(tableMutex);
+				for(size_t i = 0; i < writes.size(); i++)
+				{
+					const CellWrite& write		= writes[i];
+					const ObjectData& response	= responses[i];
+					if(response.valid)
 					{
-						// printf("Updating %s with %s\n", ((std::string) obj->getID()).c_str(), cellData.c_str());
-						bool suc = obj->updateData(cellData);
-						allSuccess &= suc;
+						size_t row = findRow(write.index.data(), write.index.size());
+						if(row < rows.size()) setCell(write.column, row, response.data);
 					}
 					else
 					{
-						throw std::runtime_error("Object NOT found in Table");
+						handleCellError(write.column, response);
+						allSuccess = false;
 					}
 				}
 			}
 
 			// Required because updateData is only called when ObjectNode is flushed and file was modifed
-			notifyChanged();
+			notifyChanged(!allSuccess);
 			if(!allSuccess) return false;
 		}
 		catch(const std::exception& e)
@@ -270,45 +566,463 @@ namespace snmpfs {
 		return true;
 	}
 
-	void Table::removeRow(std::string rowID)
+
+
+	size_t Table::findColumn(const std::string& name) const
+	{
+		size_t c = 0;
+		while(c < columns.size() && columns[c].name != name) c++;
+		return c;
+	}
+
+	void Table::invalidateColumns()
+	{
+		for(TableColumn& column : columns)
+			column.cacheValid = false;
+	}
+
+	size_t Table::findRow(const oid* index, size_t length) const
+	{
+		auto it = std::lower_bound(rows.begin(), rows.end(), index, [&](const TableSpan& row, const oid* value) {
+			return lessIndex(&indexArena[row.offset], row.length, value, length);
+		});
+		if(it == rows.end() || lessIndex(index, length, &indexArena[it->offset], it->length)) return rows.size();
+		return it - rows.begin();
+	}
+
+	/**
+	 * Same as findRow but first checks the row at hint
+	 */
+	size_t Table::findRow(const oid* index, size_t length, size_t hint) const
+	{
+		if(hint < rows.size())
+		{
+			const TableSpan& span = rows[hint];
+			if(span.length == length && std::equal(index, index + length, &indexArena[span.offset]))
+				return hint;
+		}
+		return findRow(index, length);
+	}
+
+	size_t Table::insertRow(const oid* index, size_t length)
+	{
+		auto it = std::lower_bound(rows.begin(), rows.end(), index, [&](const TableSpan& row, const oid* value) {
+			return lessIndex(&indexArena[row.offset], row.length, value, length);
+		});
+		size_t row = it - rows.begin();
+
+		TableSpan span;
+		span.offset	= indexArena.size();
+		span.length	= length;
+		indexArena.insert(indexArena.end(), index, index + length);
+		rows.insert(rows.begin() + row, span);
+		rowDirty.insert(rowDirty.begin() + row, 1);
+		rowGeneration.insert(rowGeneration.begin() + row, generation);
+		layoutValid = false;
+		invalidateColumns();
+
+		for(TableColumn& column : columns)
+		{
+			column.present.insert(column.present.begin() + row, 0);
+			if(column.numeric)	column.numbers.insert(column.numbers.begin() + row, 0);
+			else				column.strings.insert(column.strings.begin() + row, TableSpan());
+		}
+
+		return row;
+	}
+
+	/**
+	 * Removes all rows not seen by the current generation in a single pass over all columns.
+	 * Returns true if rows were removed
+	 */
+	bool Table::sweepRows()
 	{
-		for(auto& [colID, colData] : cells)
+		size_t kept = 0;
+		for(size_t r = 0; r < rows.size(); r++)
 		{
-			if(colData.contains(rowID))
+			if(rowGeneration[r] != generation)
+			{
+				TableIndex index;
+				for(size_t c = 0; c < columns.size(); c++)
+				{
+					TableColumn& column = columns[c];
+					if(!column.present[r]) continue;
+
+					if(column.indexed)
+					{
+						if(index.empty()) index = getRowIndex(r);
+						removeFromValueIndex(c, r, index);
+					}
+					if(!column.numeric)
+						arenaGarbage += column.strings[r].length;
+				}
+				indexGarbage += rows[r].length;
+				continue;
+			}
+
+			if(kept != r)
 			{
-				delete colData[rowID];
-				colData.erase(rowID);
+				rows[kept]			= rows[r];
+				rowDirty[kept]		= rowDirty[r];
+				rowGeneration[kept]	= rowGeneration[r];
+				for(TableColumn& column : columns)
+				{
+					column.present[kept] = column.present[r];
+					if(column.numeric)	column.numbers[kept] = column.numbers[r];
+					else				column.strings[kept] = column.strings[r];
+				}
 			}
+			kept++;
+		}
+
+		if(kept == rows.size()) return false;
+
+		rows.resize(kept);
+		rowDirty.resize(kept);
+		rowGeneration.resize(kept);
+		for(TableColumn& column : columns)
+		{
+			column.present.resize(kept);
+			if(column.numeric)	column.numbers.resize(kept);
+			else				column.strings.resize(kept);
+		}
+
+		layoutValid = false;
+		invalidateColumns();
+		return true;
+	}
+
+	TableIndex Table::getRowIndex(size_t row) const
+	{
+		const TableSpan& span = rows[row];
+		return TableIndex(indexArena.begin() + span.offset, indexArena.begin() + span.offset + span.length);
+	}
+
+	ObjectID Table::getCellOID(size_t column, const TableIndex& index) const
+	{
+		const ObjectID& colOID = columns[column].oid;
+		std::vector<oid> cell((oid*) colOID, ((oid*) colOID) + colOID.length());
+		cell.insert(cell.end(), index.begin(), index.end());
+		return ObjectID(cell);
+	}
+
+
+
+	void Table::appendCell(std::string& out, size_t column, size_t row) const
+	{
+		const TableColumn& col = columns[column];
+		if(!col.present[row]) return;
+
+		if(col.numeric)
+		{
+			char buffer[24];
+			auto res = std::to_chars(buffer, buffer + sizeof(buffer), col.numbers[row]);
+			out.append(buffer, res.ptr);
+		}
+		else
+		{
+			const TableSpan& span = col.strings[row];
+			out.append(arena, span.offset, span.length);
+		}
+	}
+
+	std::string Table::getCell(size_t column, size_t row) const
+	{
+		std::string cell;
+		appendCell(cell, column, row);
+		return cell;
+	}
+
+	void Table::appendRow(std::string& out, size_t row) const
+	{
+		for(size_t c = 0; c < columns.size(); c++)
+		{
+			appendCell(out, c, row);
+			if(c < columns.size() - 1)	out += colSeparator;
 		}
 	}
 
+	/**
+	 * Brings csvCache up to date
+	 */
+	void Table::render() const
+	{
+		if(!layoutValid)		renderAll();
+		else if(anyRowDirty)	renderDirtyRows();
+	}
 
-	std::set<std::string> Table::getRowIDs() const
+	/**
+	 * Renders header and all rows into csvCache and records the location of each row
+	 */
+	void Table::renderAll() const
 	{
-		std::set<std::string> ids;
+		csvCache.clear();
+		rowSpans.resize(rows.size());
+
+		// WRITE TABLE HEADER
+		for(size_t c = 0; c < columns.size(); c++)
+		{
+			csvCache += columns[c].name;
+			if(c < columns.size() - 1)	csvCache += colSeparator;
+		}
+		csvCache += rowSeparator;
 
-		for(const auto& [colID, rowData] : cells)
+		for(size_t r = 0; r < rows.size(); r++)
 		{
-			for(const auto& [rowID, cell] : rowData)
+			rowSpans[r].offset = csvCache.size();
+			appendRow(csvCache, r);
+			rowSpans[r].length = csvCache.size() - rowSpans[r].offset;
+			if(r < rows.size() - 1)		csvCache += rowSeparator;
+		}
+
+		std::fill(rowDirty.begin(), rowDirty.end(), 0);
+		anyRowDirty	= false;
+		layoutValid	= true;
+	}
+
+	/**
+	 * Renders only rows whose cells changed since the last call.
+	 * Rows keeping their length are overwritten in place, otherwise the
+	 * cache is reassembled from the unchanged spans and the new rows.
+	 */
+	void Table::renderDirtyRows() const
+	{
+		std::vector<std::pair<size_t, std::string>> rendered;
+		bool sameLength = true;
+		for(size_t r = 0; r < rows.size(); r++)
+		{
+			if(!rowDirty[r]) continue;
+
+			std::string row;
+			appendRow(row, r);
+			sameLength &= row.size() == rowSpans[r].length;
+			rendered.emplace_back(r, std::move(row));
+		}
+
+		if(sameLength)
+		{
+			for(const auto& [r, row] : rendered)
+				csvCache.replace(rowSpans[r].offset, row.size(), row);
+		}
+		else
+		{
+			std::string out;
+			out.reserve(csvCache.size());
+
+			size_t next = 0;
+			size_t copied = 0;	// end of the last unchanged part copied from csvCache
+			for(size_t r = 0; r < rows.size(); r++)
 			{
-				ids.emplace(rowID);
+				const TableSpan old = rowSpans[r];
+				out.append(csvCache, copied, old.offset - copied);
+				rowSpans[r].offset = out.size();
+
+				if(next < rendered.size() && rendered[next].first == r)
+				{
+					out += rendered[next++].second;
+				}
+				else
+				{
+					out.append(csvCache, old.offset, old.length);
+				}
+
+				rowSpans[r].length = out.size() - rowSpans[r].offset;
+				copied = old.offset + old.length;
 			}
+			out.append(csvCache, copied, std::string::npos);
+			csvCache.swap(out);
 		}
 
-		return ids;
+		std::fill(rowDirty.begin(), rowDirty.end(), 0);
+		anyRowDirty = false;
 	}
 
+	/**
+	 * Maps every value of the column to the rows containing it, kept up to date by setCell and sweepRows
+	 */
+	void Table::buildValueIndex(size_t column) const
+	{
+		const TableColumn& col = columns[column];
+		col.valueIndex.clear();
+		for(size_t r = 0; r < rows.size(); r++)
+		{
+			if(col.present[r]) col.valueIndex[getCell(column, r)].emplace(getRowIndex(r));
+		}
+		col.indexed = true;
+	}
 
-	std::string Table::makeRowID(const ObjectID& columnID, const ObjectID& cellID)
+	/**
+	 * Sets the value of a single cell, returns true if the value changed
+	 */
+	bool Table::setCell(size_t column, size_t row, const std::string& data)
 	{
-		std::stringstream ss;
+		TableColumn& col = columns[column];
+		const bool hadValue = col.present[row];
 
-		for(size_t i = columnID.length(); i < cellID.length(); i++)
+		int64_t number = 0;
+		const bool isNumber = col.numeric && parseNumber(data, number);
+
+		// First non numeric value -> column has to be stored as strings
+		if(col.numeric && !isNumber)
+			convertToStrings(col);
+
+		if(hadValue)
+		{
+			if(isNumber && col.numbers[row] == number) return false;
+			if(!isNumber && arena.compare(col.strings[row].offset, col.strings[row].length, data) == 0) return false;
+		}
+
+		// Has to happen before the old value is replaced
+		if(col.indexed)
+			updateValueIndex(column, row, data);
+
+		if(isNumber)
 		{
-			ss << "." << cellID[i];
+			col.numbers[row] = number;
 		}
+		else
+		{
+			TableSpan& span = col.strings[row];
+			if(hadValue) arenaGarbage += span.length;
+
+			span.offset	= arena.size();
+			span.length	= data.size();
+			arena += data;
+		}
+
+		col.present[row] = 1;
+		col.cacheValid = false;
+		rowDirty[row] = 1;
+		anyRowDirty = true;
+		return true;
+	}
+
+	/**
+	 * Moves the row from its current value to the given one in the secondary index of the column
+	 */
+	void Table::updateValueIndex(size_t column, size_t row, const std::string& data)
+	{
+		const TableColumn& col = columns[column];
+		TableIndex index = getRowIndex(row);
+
+		if(col.present[row]) removeFromValueIndex(column, row, index);
+		col.valueIndex[data].emplace(index);
+	}
+
+	void Table::removeFromValueIndex(size_t column, size_t row, const TableIndex& index)
+	{
+		const TableColumn& col = columns[column];
+		auto it = col.valueIndex.find(getCell(column, row));
+		if(it == col.valueIndex.end()) return;
+
+		it->second.erase(index);
+		if(it->second.empty()) col.valueIndex.erase(it);
+	}
 
-		return ss.str();
+	void Table::handleCellError(size_t column, const ObjectData& response)
+	{
+		device->logErr("Error in response for object " + ((std::string) response.id) + " " + snmp_error_code_name(response.error));
+
+		TableColumn& col = columns[column];
+		switch(response.error)
+		{
+			case SNMP_ERR_NOACCESS:
+				col.oid.setReadable(false);
+			case SNMP_ERR_NOTWRITABLE:
+				col.oid.setWritable(false);
+				break;
+		}
+	}
+
+
+
+	void Table::convertToStrings(TableColumn& column)
+	{
+		column.strings.resize(column.numbers.size());
+		for(size_t r = 0; r < column.numbers.size(); r++)
+		{
+			if(!column.present[r]) continue;
+
+			std::string value = std::to_string(column.numbers[r]);
+			column.strings[r].offset = arena.size();
+			column.strings[r].length = value.size();
+			arena += value;
+		}
+
+		column.numeric = false;
+		column.numbers.clear();
+		column.numbers.shrink_to_fit();
+	}
+
+	/**
+	 * Rebuilds the arenas once most of them is occupied by outdated values
+	 */
+	void Table::compactArena()
+	{
+		static const size_t minGarbage = 64 * 1024;
+
+		if(indexGarbage * sizeof(oid) >= minGarbage && indexGarbage >= indexArena.size() / 2)
+		{
+			std::vector<oid> compacted;
+			compacted.reserve(indexArena.size() - indexGarbage);
+			for(TableSpan& row : rows)
+			{
+				uint32_t offset = compacted.size();
+				compacted.insert(compacted.end(), indexArena.begin() + row.offset, indexArena.begin() + row.offset + row.length);
+				row.offset = offset;
+			}
+
+			indexArena.swap(compacted);
+			indexGarbage = 0;
+		}
+
+		if(arenaGarbage < minGarbage || arenaGarbage < arena.size() / 2) return;
+
+		std::string compacted;
+		compacted.reserve(arena.size() - arenaGarbage);
+		for(TableColumn& column : columns)
+		{
+			if(column.numeric) continue;
+			for(size_t r = 0; r < column.strings.size(); r++)
+			{
+				if(!column.present[r]) continue;
+
+				TableSpan& span = column.strings[r];
+				uint32_t offset = compacted.size();
+				compacted.append(arena, span.offset, span.length);
+				span.offset = offset;
+			}
+		}
+
+		arena.swap(compacted);
+		arenaGarbage = 0;
+	}
+
+
+	/**
+	 * Only accepts integers that are printed exactly like the given string
+	 * (e.g. no leading zeros), so formatting the number restores the original data
+	 */
+	bool Table::parseNumber(const std::string& data, int64_t& number)
+	{
+		if(data.empty()) return false;
+
+		const char* begin	= data.data();
+		const char* end		= begin + data.size();
+		auto res = std::from_chars(begin, end, number);
+		if(res.ec != std::errc() || res.ptr != end) return false;
+
+		char buffer[24];
+		auto out = std::to_chars(buffer, buffer + sizeof(buffer), number);
+		return data.compare(0, data.size(), buffer, out.ptr - buffer) == 0;
+	}
+
+	/**
+	 * Compares row indices numerically arc by arc, shorter indices come first on equal prefix
+	 */
+	bool Table::lessIndex(const oid* a, size_t aLength, const oid* b, size_t bLength)
+	{
+		return std::lexicographical_compare(a, a + aLength, b, b + bLength);
 	}
 
 
@@ -59,7 +59,7 @@ namespace snmpfs {
 
 
 
-	DeviceTrapHandler::DeviceTrapHandler(const std::vector<Device*>& devices) : devices(devices)
+	DeviceTrapHandler::DeviceTrapHandler(snmpFS* snmpfs) : snmpfs(snmpfs)
 	{
 
 	}
@@ -78,7 +78,9 @@ namespace snmpfs {
 	{
 		// printf("Handling TrapData for %s\n", trap.address.c_str());
 
-		Device* device = findTrapDevice(devices, trap);
+		// Devices removed meanwhile are freed once the trap was handled
+		GraveyardGuard guard(snmpfs->graveyard);
+		Device* device = findTrapDevice(*snmpfs->deviceSnapshot.get(), trap);
 		if(device)
 		{
 			// printf("Device found\n");
@@ -107,7 +109,7 @@ namespace snmpfs {
 
 
 
-	LogTrapHandler::LogTrapHandler(const std::vector<Device*>& devices) : devices(devices)
+	LogTrapHandler::LogTrapHandler(snmpFS* snmpfs) : snmpfs(snmpfs)
 	{
 
 	}
@@ -125,7 +127,8 @@ namespace snmpfs {
 	bool LogTrapHandler::handle(const TrapData& trap)
 	{
 		// TODO Maybe also move Device into TrapData ?
-		Device* device = DeviceTrapHandler::findTrapDevice(devices, trap);
+		GraveyardGuard guard(snmpfs->graveyard);
+		Device* device = DeviceTrapHandler::findTrapDevice(*snmpfs->deviceSnapshot.get(), trap);
 
 		if(!device)
 		{
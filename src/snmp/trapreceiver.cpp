@@ -4,17 +4,75 @@
 #include "snmp/trap.h"
 
 #include <algorithm>
+#include <chrono>
 #include <net-snmp/agent/agent_trap.h>
-#include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/library/large_fd_set.h>
+#include <netinet/in.h>
 #include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace snmpfs {
 
-	AbstractTrapReceiver::AbstractTrapReceiver(uint16_t port)
+	AbstractTrapReceiver::AbstractTrapReceiver(uint16_t port, uint32_t threads, ProcData* proc)
 	{
-		this->port = port;
+		this->port		= port;
+		this->threads	= std::max<uint32_t>(threads, 1);
+		this->proc		= proc;
+	}
+
+	AbstractTrapReceiver::~AbstractTrapReceiver()
+	{
+		stop();
+	}
+
+	uint16_t AbstractTrapReceiver::getPort() const
+	{
+		return port;
+	}
 
-		// Open Server
+	/**
+	 * Creates an unbound UDP socket that can share its port with the sockets of the other threads
+	 */
+	static int createSocket(int bufferSize)
+	{
+		int sock = socket(AF_INET, SOCK_DGRAM, 0);
+		if(sock < 0)
+			return -1;
+
+		int enable = 1;
+		if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+		{
+			int error = errno;
+			close(sock);
+			errno = error;
+			return -1;
+		}
+
+		// net-snmp reads the destination address of received packets to answer informs from it
+		setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &enable, sizeof(enable));
+		if(bufferSize > 0)
+			setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+		return sock;
+	}
+
+	static bool bindSocket(int sock, uint16_t port)
+	{
+		sockaddr_in addr = {};
+		addr.sin_family			= AF_INET;
+		addr.sin_port			= htons(port);
+		addr.sin_addr.s_addr	= htonl(INADDR_ANY);
+		return bind(sock, (sockaddr*) &addr, sizeof(addr)) == 0;
+	}
+
+	/**
+	 * Opens one transport per thread, all of them bound to the port.
+	 * net-snmp can't set SO_REUSEPORT before binding, so the sockets of its transports are replaced.
+	 */
+	std::vector<netsnmp_transport*> AbstractTrapReceiver::openTransports()
+	{
 		std::stringstream conString;
 		conString << "udp:" << port;
 
@@ -22,194 +80,242 @@ namespace snmpfs {
 		if (transport == NULL)
 		{
 			syslog(LOG_ERR, "couldn't open %s -- errno %d (\"%s\")\n", conString.str().c_str(), errno, strerror(errno));
-			return;
+			return {};
 		}
+		if(threads == 1)
+			return {transport};
 
+		// Keep the buffer size configured by net-snmp, the kernel reports twice the requested size
+		int bufferSize = 0;
+		socklen_t length = sizeof(bufferSize);
+		if(getsockopt(transport->sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, &length) == 0)
+			bufferSize /= 2;
 
-		// Create Session
-		netsnmp_session sess;
-		snmp_sess_init(&sess);
-		sess.callback = AbstractTrapReceiver::receiverProcess;
-		sess.callback_magic = (void *) transport;
-		sess.isAuthoritative = SNMP_SESS_NONAUTHORITATIVE;
-
-		sess.peername		= SNMP_DEFAULT_PEERNAME;  /* Original code had NULL here */
-		sess.version		= SNMP_DEFAULT_VERSION;
-		sess.community_len	= SNMP_DEFAULT_COMMUNITY_LEN;
-		sess.retries		= SNMP_DEFAULT_RETRIES;
-		sess.timeout		= SNMP_DEFAULT_TIMEOUT;
-		sess.callback		= AbstractTrapReceiver::receiverProcess;
-		sess.callback_magic	= (void *) transport;
-		sess.authenticator	= NULL;
-	// 	sess.authenticator	= auth_func;
-		sess.isAuthoritative= SNMP_SESS_NONAUTHORITATIVE;
-
-		session = snmp_add(&sess, transport, AbstractTrapReceiver::receiverPreParse, AbstractTrapReceiver::receiverPostParse);
-		if(session == NULL) {
-			snmp_syslog_err(&sess);
-			return;
+		std::vector<int> sockets;
+		for(uint32_t i = 0; i < threads; i++)
+		{
+			int sock = createSocket(bufferSize);
+			if(sock < 0)
+			{
+				syslog(LOG_WARNING, "SO_REUSEPORT not available -- errno %d (\"%s\"), receiving traps with a single thread\n", errno, strerror(errno));
+				for(int s : sockets) close(s);
+				return {transport};
+			}
+			sockets.push_back(sock);
 		}
 
-		AbstractTrapReceiver::registerReceiver(session, this);
-	}
+		// Releases the port held by the socket of net-snmp, its descriptor now refers to the first socket
+		if(dup2(sockets[0], transport->sock) < 0 || !bindSocket(transport->sock, port))
+		{
+			syslog(LOG_ERR, "couldn't bind udp:%u -- errno %d (\"%s\")\n", port, errno, strerror(errno));
+			for(int s : sockets) close(s);
+			transport->f_close(transport);
+			netsnmp_transport_free(transport);
+			return {};
+		}
+		close(sockets[0]);
 
-	AbstractTrapReceiver::~AbstractTrapReceiver()
-	{
-		AbstractTrapReceiver::unregisterReceiver(session);
-		snmp_close(session);
+		std::vector<netsnmp_transport*> transports = {transport};
+		for(uint32_t i = 1; i < threads; i++)
+		{
+			netsnmp_transport* copy = netsnmp_transport_copy(transport);
+			if(!copy || !bindSocket(sockets[i], port))
+			{
+				syslog(LOG_ERR, "couldn't bind udp:%u -- errno %d (\"%s\")\n", port, errno, strerror(errno));
+				if(copy) netsnmp_transport_free(copy);
+				close(sockets[i]);
+				continue;
+			}
+			copy->sock = sockets[i];
+			transports.push_back(copy);
+		}
+		return transports;
 	}
 
-	uint16_t AbstractTrapReceiver::getPort() const
+	/**
+	 * Opens the sockets and starts the receiver threads, handlers should be added before
+	 */
+	bool AbstractTrapReceiver::start()
 	{
-		return port;
-	}
+		stopEvent = eventfd(0, EFD_NONBLOCK);
+		if(stopEvent < 0)
+		{
+			syslog(LOG_ERR, "couldn't create eventfd -- errno %d (\"%s\")\n", errno, strerror(errno));
+			return false;
+		}
 
+		for(netsnmp_transport* transport : openTransports())
+		{
+			Listener* listener = new Listener();
+			listener->receiver	= this;
+			listener->transport	= transport;
+
+			// Create Session
+			netsnmp_session sess;
+			snmp_sess_init(&sess);
+			sess.peername		= SNMP_DEFAULT_PEERNAME;  /* Original code had NULL here */
+			sess.version		= SNMP_DEFAULT_VERSION;
+			sess.community_len	= SNMP_DEFAULT_COMMUNITY_LEN;
+			sess.retries		= SNMP_DEFAULT_RETRIES;
+			sess.timeout		= SNMP_DEFAULT_TIMEOUT;
+			sess.callback		= AbstractTrapReceiver::receiverProcess;
+			sess.callback_magic	= (void *) listener;
+			sess.authenticator	= NULL;
+			sess.isAuthoritative= SNMP_SESS_NONAUTHORITATIVE;
+
+			// Single session API, every thread reads and decodes on its own session
+			listener->handle = snmp_sess_add(&sess, transport, AbstractTrapReceiver::receiverPreParse, AbstractTrapReceiver::receiverPostParse);
+			if(listener->handle == NULL)
+			{
+				snmp_syslog_err(&sess);
+				delete listener;
+				continue;
+			}
 
+			listener->thread = std::thread(&AbstractTrapReceiver::listen, this, listener);
+			listeners.push_back(listener);
+		}
 
-	static bool receiverRunning = false;
-	static std::mutex receiverMutex;
-	static std::thread receiverThread;
-	static std::map<netsnmp_session*, AbstractTrapReceiver*> receiverMap;
+		if(proc) proc->trapThreads.set(listeners.size());
+		syslog(LOG_INFO, "Receiving traps on udp:%u with %lu threads\n", port, listeners.size());
+		return !listeners.empty();
+	}
 
-	void AbstractTrapReceiver::registerReceiver(netsnmp_session* session, AbstractTrapReceiver* receiver)
+	void AbstractTrapReceiver::stop()
 	{
-		std::unique_lock<std::mutex> lock(receiverMutex);
-		receiverMap[session] = receiver;
+		if(stopEvent < 0)
+			return;
+
+		uint64_t value = 1;
+		if(write(stopEvent, &value, sizeof(value)) < 0)
+			syslog(LOG_ERR, "couldn't stop trap receiver -- errno %d (\"%s\")\n", errno, strerror(errno));
 
-		// Start receiverThread if not already running
-		if(!receiverRunning)
+		for(Listener* listener : listeners)
 		{
-			receiverRunning = true;
-			receiverThread = std::thread(&AbstractTrapReceiver::receiverLoop);
+			listener->thread.join();
+			snmp_sess_close(listener->handle);
+			delete listener;
 		}
+		listeners.clear();
+
+		close(stopEvent);
+		stopEvent = -1;
 	}
 
-	void AbstractTrapReceiver::unregisterReceiver(netsnmp_session* session)
+	void AbstractTrapReceiver::listen(Listener* listener)
 	{
-		std::unique_lock<std::mutex> lock(receiverMutex);
-		receiverMap.erase(session);
-
-		// Stop receiverThread if nomore receivers are in the receiverMap
-		if(receiverRunning && receiverMap.size() == 0)
+		int sock = listener->transport->sock;
+		int epoll = epoll_create1(0);
+		if(epoll < 0)
 		{
-			receiverRunning = false;
-			receiverThread.join();
+			syslog(LOG_ERR, "couldn't create epoll -- errno %d (\"%s\")\n", errno, strerror(errno));
+			return;
 		}
-	}
 
-	int AbstractTrapReceiver::receiverPreParse(netsnmp_session* session, netsnmp_transport* transport, void* transport_data, int transport_data_length)
-	{
-		std::unique_lock<std::mutex> lock(receiverMutex);
-		if(!receiverMap.contains(session)) return 0;
-		AbstractTrapReceiver* receiver = receiverMap[session];
+		epoll_event event = {};
+		event.events	= EPOLLIN;
+		event.data.fd	= sock;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, sock, &event);
+		event.data.fd	= stopEvent;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, stopEvent, &event);
+
+		// Descriptors of large processes exceed FD_SETSIZE
+		netsnmp_large_fd_set fds;
+		netsnmp_large_fd_set_init(&fds, sock + 1);
+
+		bool running = true;
+		while(running)
+		{
+			epoll_event events[2];
+			int count = epoll_wait(epoll, events, 2, 1000);
+			if(count < 0 && errno != EINTR)
+			{
+				syslog(LOG_ERR, "epoll_wait failed -- errno %d (\"%s\")\n", errno, strerror(errno));
+				break;
+			}
+
+			for(int i = 0; i < count; i++)
+			{
+				if(events[i].data.fd == stopEvent)
+				{
+					running = false;
+					break;
+				}
 
-		if(!session)
-			throw std::runtime_error("No trap receiver for given session");
+				// Reads and decodes a single datagram, further ones keep the socket readable
+				NETSNMP_LARGE_FD_ZERO(&fds);
+				NETSNMP_LARGE_FD_SET(sock, &fds);
+				snmp_sess_read2(listener->handle, &fds);
+			}
+			publish(listener, false);
+		}
+		publish(listener, true);
 
-		return receiver->pre_parse(session, transport, transport_data, transport_data_length);
+		netsnmp_large_fd_set_cleanup(&fds);
+		close(epoll);
 	}
 
-	int AbstractTrapReceiver::receiverPostParse(netsnmp_session* session, netsnmp_pdu* pdu, int unknown)
+	/**
+	 * Adds the counts of the thread to the proc counters about once per second, so traps are counted without shared state
+	 */
+	void AbstractTrapReceiver::publish(Listener* listener, bool force)
 	{
-		std::unique_lock<std::mutex> lock(receiverMutex);
-		if(!receiverMap.contains(session)) return 0;
-		AbstractTrapReceiver* receiver = receiverMap[session];
+		if(!proc) return;
 
-		if(!session)
-			throw std::runtime_error("No trap receiver for given session");
+		uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		if(!force && now - listener->published < 1000)
+			return;
 
-		return receiver->post_parse(session, pdu, unknown);
+		if(listener->received)	proc->trapReceived.add(listener->received);
+		if(listener->rejected)	proc->trapRejected.add(listener->rejected);
+		listener->received	= 0;
+		listener->rejected	= 0;
+		listener->published	= now;
 	}
 
-	int AbstractTrapReceiver::receiverProcess(int op, netsnmp_session* session, int reqid, netsnmp_pdu* pdu, void* magic)
+	int AbstractTrapReceiver::receiverPreParse(netsnmp_session* session, netsnmp_transport* transport, void* transport_data, int transport_data_length)
 	{
-		std::unique_lock<std::mutex> lock(receiverMutex);
-		if(!receiverMap.contains(session)) return 0;
-		AbstractTrapReceiver* receiver = receiverMap[session];
-
-		if(!session)
-			throw std::runtime_error("No trap receiver for given session");
+		Listener* listener = (Listener*) session->callback_magic;
+		return listener->receiver->pre_parse(session, transport, transport_data, transport_data_length);
+	}
 
-		return receiver->process(op, session, reqid, pdu, magic);
+	int AbstractTrapReceiver::receiverPostParse(netsnmp_session* session, netsnmp_pdu* pdu, int unknown)
+	{
+		Listener* listener = (Listener*) session->callback_magic;
+		return listener->receiver->post_parse(session, pdu, unknown);
 	}
 
-	/**
-	 * Code literally taken 1:1 from snmptrapd.c
-	 */
-	void AbstractTrapReceiver::receiverLoop()
+	int AbstractTrapReceiver::receiverProcess(int op, netsnmp_session* session, int reqid, netsnmp_pdu* pdu, void* magic)
 	{
-		int             count, numfds, block;
-		fd_set          readfds,writefds,exceptfds;
-		struct timeval  timeout;
-
-		while (receiverRunning) {
-			numfds = 0;
-			FD_ZERO(&readfds);
-			FD_ZERO(&writefds);
-			FD_ZERO(&exceptfds);
-			block = 0;
-			timerclear(&timeout);
-			timeout.tv_sec = 5;
-			snmp_select_info(&numfds, &readfds, &timeout, &block);
-
-			#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-			netsnmp_external_event_info(&numfds, &readfds, &writefds, &exceptfds);
-			#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
-
-			block = 0;
-			count = select(numfds, &readfds, &writefds, &exceptfds, !block ? &timeout : NULL);
-
-			if (count > 0) {
-				#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-				netsnmp_dispatch_external_events(&count, &readfds, &writefds,
-												&exceptfds);
-				#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
-				/* If there are any more events after external events, then
-				* try SNMP events. */
-				if (count > 0) {
-					snmp_read(&readfds);
-				}
-			} else {
-				switch (count) {
-					case 0:
-						snmp_timeout();
-						break;
-					case -1:
-						if (errno == EINTR)
-							continue;
-						snmp_log_perror("select");
-						break;
-					default:
-						fprintf(stderr, "select returned %d\n", count);
-						break;
-				}
-			}
-			run_alarms();
-		}
+		Listener* listener = (Listener*) magic;
+		if(op == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+			listener->received++;
+		return listener->receiver->process(op, session, reqid, pdu, magic);
 	}
 
 
 
 
-	TrapReceiver::TrapReceiver(uint16_t port) : AbstractTrapReceiver(port)
+	TrapReceiver::TrapReceiver(uint16_t port, uint32_t threads, ProcData* proc) : AbstractTrapReceiver(port, threads, proc)
 	{
 
 	}
 
 	TrapReceiver::~TrapReceiver()
 	{
-
+		// Threads call into this object, so they have to stop before it is destroyed
+		stop();
 	}
 
 	void TrapReceiver::addHandler(AbstractTrapHandler* handler)
 	{
-		std::unique_lock<std::mutex> lock(handlerMutex);
+		std::unique_lock<std::shared_mutex> lock(handlerMutex);
 		handlers.push_back(handler);
 	}
 
 	void TrapReceiver::freeHandlers()
 	{
-		std::unique_lock<std::mutex> lock(handlerMutex);
+		std::unique_lock<std::shared_mutex> lock(handlerMutex);
 
 		for(AbstractTrapHandler* handler : handlers)
 			delete handler;
@@ -219,7 +325,7 @@ namespace snmpfs {
 
 	void TrapReceiver::removeHandler(AbstractTrapHandler* handler)
 	{
-		std::unique_lock<std::mutex> lock(handlerMutex);
+		std::unique_lock<std::shared_mutex> lock(handlerMutex);
 		handlers.erase(std::remove(handlers.begin(), handlers.end(), handler), handlers.end());
 	}
 
@@ -316,7 +422,8 @@ namespace snmpfs {
 		// printf(" -> COMMAND: %d\n", rawPDU->command);
 		// printf(" -> traptype: %ld\n", pdu->trap_type);
 
-		netsnmp_transport* transport = (netsnmp_transport *) magic;
+		Listener* listener = (Listener*) magic;
+		netsnmp_transport* transport = listener->transport;
 		char* addr_string = transport->f_fmtaddr(transport, pdu->transport_data, pdu->transport_data_length);
 
 		TrapData trap;
@@ -325,6 +432,7 @@ namespace snmpfs {
 		free(addr_string);
 
 
+		std::shared_lock<std::shared_mutex> lock(handlerMutex);
 		for(AbstractTrapHandler* handler : handlers)
 		{
 			bool accept = handler->handle(trap);
@@ -335,9 +443,11 @@ namespace snmpfs {
 			else
 			{
 				// printf("Trap rejected by %s\n", handler->getName().c_str());
+				listener->rejected++;
 				break;
 			}
 		}
+		lock.unlock();
 
 		// printf(" -> COMMAND: %d\n", pdu->command);
 		// printf(" -> COMMAND");
@@ -374,7 +484,7 @@ namespace snmpfs {
 				reply->errstat	= 0;
 				reply->errindex	= 0;
 
-				if(!snmp_send(session, reply))
+				if(!snmp_sess_send(listener->handle, reply))
 				{
 					// printf(" -> ERROR Reply\n");
 					snmp_sess_perror("snmpfs: Couldn't respond to inform pdu", session);
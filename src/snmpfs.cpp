@@ -7,8 +7,11 @@
 #include "fuse/virtualfile.h"
 #include "fuse/virtuallogger.h"
 #include "proc.h"
+#include "reload.h"
 #include "snmpfs.h"
 #include "snmp/device.h"
+#include "snmp/mibindex.h"
+#include "snmp/mibloader.h"
 #include "snmp/table.h"
 #include "snmp/traphandler.h"
 #include "snmp/trapreceiver.h"
@@ -24,6 +27,7 @@
 #include <errno.h>
 #include <fstream>
 #include <queue>
+#include <signal.h>
 #include <stdio.h>
 #include <string>
 #include <string.h>
@@ -40,11 +44,34 @@ namespace snmpfs {
 	#define LOGD(path, data)
 #endif
 
-	bool initSNMP(const snmpfsConfig& config)
+	/**
+	 * Collects the OIDs of all objects and columns used by devices and templates
+	 */
+	static std::vector<std::string> collectOIDs(const snmpfsConfig& config)
 	{
-		// INIT SNMP
-		init_snmp("snmpfs");
+		std::vector<std::string> oids;
+		auto collect = [&oids](const std::vector<ObjectConfig>& objects)
+		{
+			for(const ObjectConfig& object : objects)
+			{
+				if(object.type == REUSE) continue;
+				oids.push_back(object.rawOID);
+				for(const ConfigEntry& column : object.columns)
+					oids.push_back(column.rawOID);
+			}
+		};
+
+		for(const DeviceConfig& device : config.devices)	collect(device.objects.get());
+		for(const TemplateConfig& tmp : config.templates)	collect(tmp.objects);
+
+		// Templates are copied into devices, so most OIDs show up several times
+		std::sort(oids.begin(), oids.end());
+		oids.erase(std::unique(oids.begin(), oids.end()), oids.end());
+		return oids;
+	}
 
+	static bool loadAllMIBs(const snmpfsConfig& config)
+	{
 		// LOAD SYSTEM MIBS
 		if(config.loadSystemMIBs)
 		{
@@ -86,6 +113,90 @@ namespace snmpfs {
 		return true;
 	}
 
+	static bool loadRequiredMIBs(const snmpfsConfig& config, const std::vector<std::string>& oids)
+	{
+		// SCAN MODULE HEADERS, SPECIFIED MIBS TAKE PRECEDENCE
+		MIBLoader loader;
+		for(const std::filesystem::path& mib : config.mibs)
+		{
+			if(!loader.scan(mib))
+			{
+				printf("Error loading MIB from %s\n", mib.c_str());
+				return false;
+			}
+		}
+		if(config.loadSystemMIBs)
+			loader.scanSystem();
+
+		// FALL BACK TO ALL MIBS IF A LABEL IS DEFINED NOWHERE
+		for(const std::string& raw : oids)
+		{
+			if(!loader.require(raw))
+			{
+				syslog(LOG_INFO, "No MIB module defines %s, loading all MIBs\n", raw.c_str());
+				return loadAllMIBs(config);
+			}
+		}
+
+		syslog(LOG_INFO, "Loading %lu of %lu MIB modules\n", loader.getRequiredCount(), loader.getModuleCount());
+		if(!loader.load())
+			return false;
+
+		// The scanner only understands parts of ASN.1, labels it attributed wrongly are still unknown to net-snmp
+		for(const std::string& raw : oids)
+		{
+			oid name[MAX_OID_LEN];
+			size_t length = MAX_OID_LEN;
+			if(!snmp_parse_oid(raw.c_str(), name, &length))
+			{
+				syslog(LOG_INFO, "Can't resolve %s with the selected MIB modules, loading all MIBs\n", raw.c_str());
+				return loadAllMIBs(config);
+			}
+		}
+		return true;
+	}
+
+	bool initSNMP(const snmpfsConfig& config)
+	{
+		// INIT SNMP
+		init_snmp("snmpfs");
+		snmp_use_mib_index();
+
+		// USE CACHED MIB INDEX IF NO MIB FILE CHANGED
+		MIBIndex& index = MIBIndex::global();
+		std::vector<std::string> oids = config.selectiveMIBs ? collectOIDs(config) : std::vector<std::string>();
+		uint64_t fingerprint = MIBIndex::fingerprint(config.mibs, config.loadSystemMIBs, oids);
+		if(!config.mibCache.empty() && index.load(config.mibCache, fingerprint))
+		{
+			syslog(LOG_INFO, "Loaded MIB index with %lu nodes from %s\n", index.size(), config.mibCache.c_str());
+
+			// net-snmp parses the MIBs only if it is asked for something the index can't answer
+			index.setTreeLoader([config, oids]()
+			{
+				syslog(LOG_INFO, "Loading MIBs into net-snmp\n");
+				return config.selectiveMIBs ? loadRequiredMIBs(config, oids) : loadAllMIBs(config);
+			});
+			return true;
+		}
+
+		// LOAD MIBS
+		bool loaded = config.selectiveMIBs ? loadRequiredMIBs(config, oids) : loadAllMIBs(config);
+		if(!loaded)
+			return false;
+
+		// BUILD INDEX FROM PARSED MIBS
+		if(!index.build(get_tree_head(), fingerprint))
+		{
+			printf("Error building MIB index\n");
+			return false;
+		}
+
+		if(!config.mibCache.empty() && !index.save(config.mibCache))
+			printf("Error writing MIB index to %s\n", config.mibCache.c_str());
+
+		return true;
+	}
+
 	snmpFS* createFS(const snmpfsConfig& config)
 	{
 		openlog("snmpfs", LOG_PID, 0);
@@ -94,28 +205,38 @@ namespace snmpfs {
 
 		snmpFS* snmpfs = new struct snmpFS;
 		snmpfs->active = true;
-		snmpfs->taskManager.start();
+		snmpfs->taskManager.start(config.workers, &snmpfs->proc);
 
 		// Create root of FS
 		snmpfs->root = new FileNode("/");
 
+		// Every Device is visible right after mounting, its directory is filled once initialized
+		for(const DeviceConfig& device : config.devices)
+			snmpfs->root->addChild(new FileNode(device.name));
+
 		// Create Devices
-		DeviceInitTask* initTask = new DeviceInitTask(snmpfs, config.devices);
-		snmpfs->taskManager.addTask(initTask);
+		DeviceInitTask* initTask = new DeviceInitTask(snmpfs, config.devices, config.initConcurrency);
+		snmpfs->initTasks.push_back(initTask);
+		initTask->start();
+
+		// Applies changes of the configuration on request
+		snmpfs->reloader = new ConfigReloader(snmpfs, config);
 
 		// Create TrapReceiver
 		if(config.trap.port > 0)
 		{
-			snmpfs->trapReceiver = new TrapReceiver(config.trap.port);
+			snmpfs->trapReceiver = new TrapReceiver(config.trap.port, config.trap.threads, &snmpfs->proc);
 
 			AuthTrapHandler* authHandler = new AuthTrapHandler(config.trap.auth);
 			snmpfs->trapReceiver->addHandler(authHandler);
 
-			DeviceTrapHandler* deviceHandler = new DeviceTrapHandler(snmpfs->devices);
+			DeviceTrapHandler* deviceHandler = new DeviceTrapHandler(snmpfs);
 			snmpfs->trapReceiver->addHandler(deviceHandler);
 
-			LogTrapHandler* logHandler = new LogTrapHandler(snmpfs->devices);
+			LogTrapHandler* logHandler = new LogTrapHandler(snmpfs);
 			snmpfs->trapReceiver->addHandler(logHandler);
+
+			snmpfs->trapReceiver->start();
 		}
 
 		// Create PROCFS
@@ -124,7 +245,9 @@ namespace snmpfs {
 		snmpfs->proc.snmpfsUID.set(std::to_string(getuid()));
 		snmpfs->proc.snmpfsGID.set(std::to_string(getgid()));
 		snmpfs->proc.snmpfsVersion.set(APP_VERSION);
-		insertFileNodeByPath("proc", createProcFS(&snmpfs->proc), snmpfs->root);
+		FileNode* proc = createProcFS(&snmpfs->proc);
+		proc->addChild(new ReloadNode("reload", snmpfs->reloader));
+		insertFileNodeByPath("proc", proc, snmpfs->root);
 
 		return snmpfs;
 	}
@@ -141,10 +264,22 @@ namespace snmpfs {
 		// WHILE WAITING FOR TASKS TO FINISH, SHUTDOWN OTHER PARTS
 		if(snmpfs->trapReceiver)
 		{
+			snmpfs->trapReceiver->stop();
 			snmpfs->trapReceiver->freeHandlers();
 			delete snmpfs->trapReceiver;
 		}
 
+		// A running reload might still add Devices
+		snmpfs->reloader->stop();
+
+		// Devices still backing off are not initialized anymore
+		for(DeviceInitTask* initTask : snmpfs->initTasks)
+		{
+			initTask->stop();
+			delete initTask;
+		}
+		snmpfs->initTasks.clear();
+
 		// NOW WE MUST WAIT FOR TASKS TO BE DONE (Devices might be accessed!)
 		syslog(LOG_INFO, "[TaskManager] Waiting for Tasks to finish");
 		snmpfs->taskManager.join();
@@ -156,6 +291,9 @@ namespace snmpfs {
 		snmpfs->root->freeChilds();
 		delete snmpfs->root;
 
+		// NODES, OBJECTS AND DEVICES REMOVED BY RELOADS
+		snmpfs->graveyard.clear();
+
 		// EVENTUALLY FREE DEVICES
 		syslog(LOG_INFO, "Destroying Devices");
 		for(Device* device : snmpfs->devices)
@@ -164,6 +302,7 @@ namespace snmpfs {
 			device->cleanupSNMP();
 			delete device;
 		}
+		delete snmpfs->reloader;
 
 		// FREE snmpfs
 		delete snmpfs;
@@ -227,6 +366,37 @@ namespace snmpfs {
 		destroyFS(snmpfs);
 	}
 
+	/**
+	 * Waits for the initialization of the Device the path points into (if not done yet),
+	 * depth is the number of path components below the Device directory required to wait.
+	 * Returns false if the Device is still offline, its directory stays empty until a later probe succeeds.
+	 */
+	static bool awaitDevice(snmpFS* snmpfs, const std::filesystem::path& path, size_t depth)
+	{
+		auto it = path.begin();
+		if(it == path.end() || *it != "/") return true;
+		if(++it == path.end()) return true;
+		std::string device = *it;
+
+		size_t below = std::distance(++it, path.end());
+		if(below < depth) return true;
+
+		// Devices added again by a reload are handled by the latest Task, finished Tasks are freed only after leaving
+		GraveyardGuard guard(snmpfs->graveyard);
+		snmpfs->mutex.lock();
+		std::vector<DeviceInitTask*> initTasks = snmpfs->initTasks;
+		snmpfs->mutex.unlock();
+		for(auto task = initTasks.rbegin(); task != initTasks.rend(); task++)
+		{
+			if((*task)->hasDevice(device))
+			{
+				DeviceInitState::Phase phase = (*task)->awaitDevice(device);
+				return phase == DeviceInitState::READY || phase == DeviceInitState::FAILED;
+			}
+		}
+		return true;
+	}
+
 	static int snmpfs_getattr(const char* path, struct stat* stbuf, struct fuse_file_info *fi)
 	{
 		LOG(path);
@@ -244,11 +414,13 @@ namespace snmpfs {
 			return 0;
 		}
 
-		// File
+		// File (Device directories themselves exist before initialization)
+		bool available = awaitDevice(snmpfs, path, 1);
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
-		if(!node) return -ENOENT;
+		if(!node) return available ? -ENOENT : -EAGAIN;
 
 		stbuf->st_uid	= getuid();
 		stbuf->st_gid	= getgid();
@@ -276,14 +448,18 @@ namespace snmpfs {
 		filler(buf, ".", NULL, 0, 0);
 		filler(buf, "..", NULL, 0, 0);
 
+		awaitDevice(snmpfs, path, 0);
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* dirNode = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
+		std::vector<std::string> names;
+		if(dirNode) names = dirNode->getChildNames();
 		snmpfs->mutex.unlock();
 		if(dirNode == NULL) return -ENOENT;
 
-		for(FileNode* fileNode : dirNode->children)
+		for(const std::string& name : names)
 		{
-			filler(buf, fileNode->name.c_str(), NULL, 0, 0);
+			filler(buf, name.c_str(), NULL, 0, 0);
 		}
 
 		return 0;
@@ -297,13 +473,17 @@ namespace snmpfs {
 
 		bool trunc = fi->flags & O_TRUNC;
 
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
-		if(node)
-			return node->open(trunc);
+		if(!node) return 0;
 
-		return 0;
+		int res = node->open(trunc);
+		std::string data;
+		if(res == 0 && node->snapshot(data))
+			fi->fh = (uint64_t) new std::string(std::move(data));
+		return res;
 	}
 
 	static int snmpfs_read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi)
@@ -312,6 +492,19 @@ namespace snmpfs {
 		fuse_context* context = fuse_get_context();
 		snmpFS* snmpfs = (snmpFS*) context->private_data;
 
+		// Handles with a snapshot are served from the copy taken on open
+		if(fi && fi->fh)
+		{
+			const std::string* data = (const std::string*) fi->fh;
+			if(offset >= (off_t) data->size())
+				return 0;
+
+			size = std::min(size, data->size() - offset);
+			memcpy(buf, data->data() + offset, size);
+			return size;
+		}
+
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
@@ -327,6 +520,7 @@ namespace snmpfs {
 		fuse_context* context = fuse_get_context();
 		snmpFS* snmpfs = (snmpFS*) context->private_data;
 
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
@@ -342,6 +536,7 @@ namespace snmpfs {
 		fuse_context* context = fuse_get_context();
 		snmpFS* snmpfs = (snmpFS*) context->private_data;
 
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
@@ -357,6 +552,13 @@ namespace snmpfs {
 		fuse_context* context = fuse_get_context();
 		snmpFS* snmpfs = (snmpFS*) context->private_data;
 
+		if(fi && fi->fh)
+		{
+			delete (std::string*) fi->fh;
+			fi->fh = 0;
+		}
+
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
@@ -372,6 +574,7 @@ namespace snmpfs {
 		fuse_context* context = fuse_get_context();
 		snmpFS* snmpfs = (snmpFS*) context->private_data;
 
+		GraveyardGuard guard(snmpfs->graveyard);
 		snmpfs->mutex.lock();
 		FileNode* node = getFileNodeByPath(std::filesystem::path(path), snmpfs->root);
 		snmpfs->mutex.unlock();
@@ -510,6 +713,16 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	// SIGHUP reloads the configuration instead of unmounting
+	struct sigaction action = {};
+	action.sa_handler = ConfigReloader::signal;
+	sigemptyset(&action.sa_mask);
+	if(sigaction(SIGHUP, &action, NULL) != 0)
+	{
+		printf("Error setting reload signal handler\n");
+		return EXIT_FAILURE;
+	}
+
 	// BLOCK UNTIL CTRL+C or fusermount -u
 	int ret;
 	if(opts.singlethread)
@@ -0,0 +1,166 @@
+#include "snmp/mibindex.h"
+#include "snmp/objectid.h"
+
+#include <filesystem>
+#include <stdio.h>
+
+using namespace snmpfs;
+
+struct Write {
+	const char* name;
+	char type;
+	const char* data;
+};
+
+static const char* names[] = {
+	"SNMPFS-TEST-MIB::testString.0",
+	"testString.0",
+	"testStatus.0",
+	"testCounter.7",
+	"enterprises.99999.3.1.2.7",
+	".1.3.6.1.4.1.99999.4.0",
+	"sysDescr.0",
+};
+
+static const Write writes[] = {
+	{"testString.0",	'=',	"hello"},
+	{"testStatus.0",	'=',	"down"},
+	{"testStatus.0",	'i',	"testing"},
+	{"testStatus.0",	'i',	"3"},
+	{"testStatus.0",	'i',	"unknown"},
+	{"testTarget.0",	'=',	".1.3.6.1.4.1.99999"},
+	{"testCounter.7",	'=',	"5"},
+	{"testTable",		'=',	"1"},
+};
+
+/**
+ * Everything snmpfs asks net-snmp or the MIBIndex about the test MIB, one line per answer
+ */
+static std::vector<std::string> describe()
+{
+	std::vector<std::string> lines;
+
+	for(const char* name : names)
+	{
+		std::string line = std::string(name) + " ->";
+		try
+		{
+			ObjectID id(name);
+			line += " " + (std::string) id;
+			if(id.hasMIB())
+				line += " type " + std::to_string(id.getMIB()->type) + " access " + std::to_string(id.getMIB()->access);
+		}
+		catch(const std::exception& e)
+		{
+			line += " unresolved";
+		}
+		lines.push_back(line);
+	}
+
+	for(const Write& write : writes)
+	{
+		ObjectID id(write.name);
+		char type			= write.type;
+		std::string data	= write.data;
+		int error = MIBIndex::global().resolveValue(id, id.length(), type, data);
+
+		netsnmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_SET);
+		if(error == SNMPERR_SUCCESS)
+			error = snmp_add_var(pdu, id, id.length(), type, data.c_str());
+		snmp_free_pdu(pdu);
+
+		std::string line = std::string(write.name) + " = " + write.data + " ->";
+		if(error == SNMPERR_SUCCESS)	line += " " + std::string(1, type) + " " + data;
+		else							line += " error " + std::to_string(error);
+		lines.push_back(line);
+	}
+
+	// OID values are printed the same way regardless of the modules net-snmp knows
+	ObjectID target(".1.3.6.1.4.1.99999.1");
+	netsnmp_variable_list* var = nullptr;
+	snmp_varlist_add_variable(&var, target, target.length(), ASN_OBJECT_ID, (oid*) target, target.length() * sizeof(oid));
+	size_t bufferSize	= 256;
+	size_t outLen		= 0;
+	u_char* buffer		= (u_char*) malloc(bufferSize);
+	sprint_realloc_by_type(&buffer, &bufferSize, &outLen, 1, var, nullptr, nullptr, nullptr);
+	lines.push_back("value -> " + std::string((const char*) buffer, outLen));
+	free(buffer);
+	snmp_free_varbind(var);
+
+	return lines;
+}
+
+static bool contains(const std::vector<std::string>& lines, const std::string& expected)
+{
+	for(const std::string& line : lines)
+	{
+		if(line == expected)
+			return true;
+	}
+	printf("FAILED: missing \"%s\"\n", expected.c_str());
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("Usage: %s <directory of test MIBs>\n", argv[0]);
+		return 1;
+	}
+
+	int failed = 0;
+	std::filesystem::path cache = std::filesystem::temp_directory_path() / "snmpfs-test-mibindex";
+
+	// COLD START, net-snmp parses the MIBs and the index is built from its tree
+	init_snmp("snmpfs-test");
+	snmp_use_mib_index();
+	std::filesystem::path mib = std::filesystem::path(argv[1]) / "SNMPFS-TEST-MIB.txt";
+	if(!read_mib(mib.c_str()))
+	{
+		printf("FAILED: can't load %s\n", mib.c_str());
+		return 1;
+	}
+
+	MIBIndex& index = MIBIndex::global();
+	if(!index.build(get_tree_head(), 1) || !index.save(cache))
+	{
+		printf("FAILED: can't build MIB index\n");
+		return 1;
+	}
+	std::vector<std::string> cold = describe();
+
+	// CACHED START, net-snmp knows no MIBs at all
+	shutdown_mib();
+	index.clear();
+	if(!index.load(cache, 1))
+	{
+		printf("FAILED: can't load MIB index from %s\n", cache.c_str());
+		return 1;
+	}
+	std::vector<std::string> cached = describe();
+	std::filesystem::remove(cache);
+
+	for(size_t i = 0; i < cold.size() && i < cached.size(); i++)
+	{
+		if(cold[i] != cached[i])
+		{
+			printf("FAILED: cold start \"%s\", cached start \"%s\"\n", cold[i].c_str(), cached[i].c_str());
+			failed++;
+		}
+	}
+	if(cold.size() != cached.size())
+		failed++;
+
+	// Both would be equal if nothing was resolved at all
+	failed += !contains(cached, "testString.0 -> .1.3.6.1.4.1.99999.1.0 type " + std::to_string(TYPE_OCTETSTR) + " access " + std::to_string(MIB_ACCESS_READWRITE));
+	failed += !contains(cached, "testStatus.0 = down -> i 2");
+	failed += !contains(cached, "testStatus.0 = testing -> i 3");
+	failed += !contains(cached, "testStatus.0 = unknown -> error " + std::to_string(SNMPERR_VALUE));
+	failed += !contains(cached, "testCounter.7 = 5 -> c 5");
+	failed += !contains(cached, "value -> .1.3.6.1.4.1.99999.1");
+
+	if(failed == 0)
+		printf("All MIBIndex tests passed\n");
+	return failed == 0 ? 0 : 1;
+}
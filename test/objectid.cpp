@@ -0,0 +1,50 @@
+#include "snmp/objectid.h"
+
+#include <stdio.h>
+
+using namespace snmpfs;
+
+static bool expectOwners(const std::map<ObjectID, int>& entries, const char* id, std::vector<int> expected)
+{
+	std::vector<int> owners = findOwners(entries, ObjectID(id));
+	if(owners == expected)
+		return true;
+
+	printf("FAILED: owners of %s:", id);
+	for(int owner : owners)
+		printf(" %d", owner);
+	printf("\n");
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+
+	std::map<ObjectID, int> entries;
+	entries[ObjectID(".1.3.6.1.2.1.2.2")]			= 1;	// ifTable
+	entries[ObjectID(".1.3.6.1.2.1.2.2.1.1.5")]		= 2;	// single cell configured next to ifTable
+	entries[ObjectID(".1.3.6.1.4.1.9")]				= 3;	// table
+	entries[ObjectID(".1.3.6.1.4.1.9.9.1")]			= 4;	// table nested under the same prefix
+	entries[ObjectID(".1.3.6.1.2.1.1.5.0")]			= 5;	// sysName
+
+	// Exact matches only return the entry itself
+	failed += !expectOwners(entries, ".1.3.6.1.2.1.1.5.0", {5});
+	failed += !expectOwners(entries, ".1.3.6.1.2.1.2.2.1.1.5", {2});
+
+	// Cells find their Table even if other entries sort in between
+	failed += !expectOwners(entries, ".1.3.6.1.2.1.2.2.1.2.3", {1});
+	failed += !expectOwners(entries, ".1.3.6.1.4.1.9.10.1", {3});
+
+	// Nested Tables both own the cell
+	failed += !expectOwners(entries, ".1.3.6.1.4.1.9.9.1.2.7", {4, 3});
+
+	// Unrelated OIDs have no owner
+	failed += !expectOwners(entries, ".1.3.6.1.2.1.1.6.0", {});
+	failed += !expectOwners(entries, ".1.3.6.1.2.1.2.1.0", {});
+	failed += !expectOwners(entries, ".1.3.6.1.6.3.1.1.4.1.0", {});
+
+	if(failed == 0)
+		printf("All ObjectID tests passed\n");
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "core/taskmanager.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+using namespace snmpfs;
+
+/**
+ * Runs until released, keeps its worker busy
+ */
+class BlockingTask : public Task
+{
+public:
+	BlockingTask() : Task(SINGLE) {}
+	size_t getAffinity() const { return 0; }
+
+	std::atomic<bool> started	= false;
+	std::atomic<bool> release	= false;
+	std::atomic<bool> finished	= false;
+
+private:
+	void run()
+	{
+		started = true;
+		while(!release)
+			std::this_thread::sleep_for(std::chrono::microseconds(10));
+		finished = true;
+	}
+};
+
+/**
+ * Only records that it was executed
+ */
+class MarkTask : public Task
+{
+public:
+	MarkTask() : Task(SINGLE) {}
+	size_t getAffinity() const { return 0; }
+
+	std::atomic<bool> done = false;
+
+private:
+	void run()
+	{
+		done = true;
+	}
+};
+
+static bool waitFor(const std::atomic<bool>& flag, uint64_t timeout)
+{
+	auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	while(!flag)
+	{
+		if(std::chrono::steady_clock::now() > until)
+			return false;
+		std::this_thread::sleep_for(std::chrono::microseconds(10));
+	}
+	return true;
+}
+
+/**
+ * Both Tasks map to the first worker, the second one can only be executed in time if the idle worker steals it
+ */
+static bool stealsFromBusyWorker(TaskManager& taskManager)
+{
+	BlockingTask* blocking = new BlockingTask();
+	taskManager.addTask(blocking);
+	if(!waitFor(blocking->started, 1000))
+		return false;
+
+	MarkTask* mark = new MarkTask();
+	taskManager.addTask(mark);
+	bool stolen = waitFor(mark->done, 1000);
+
+	blocking->release = true;
+	waitFor(blocking->finished, 1000);
+	waitFor(mark->done, 1000);
+	return stolen;
+}
+
+/**
+ * Finishes the BlockingTask while being dispatched to its worker, so the worker is still marked busy
+ * but waits for the TaskManager and takes the Task before the idle worker woken to steal it
+ */
+class RacingTask : public MarkTask
+{
+public:
+	RacingTask(BlockingTask* blocking) : blocking(blocking) {}
+
+	size_t getAffinity() const
+	{
+		if(!blocking->release.exchange(true))
+		{
+			waitFor(blocking->finished, 1000);
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+		return 0;
+	}
+
+private:
+	BlockingTask* blocking;
+};
+
+/**
+ * Idle workers that lost the race for a Task have to be available for stealing afterwards
+ */
+static bool stealsAfterLostRace(TaskManager& taskManager)
+{
+	for(int round = 0; round < 3; round++)
+	{
+		BlockingTask* blocking = new BlockingTask();
+		taskManager.addTask(blocking);
+		if(!waitFor(blocking->started, 1000))
+			return false;
+
+		RacingTask* racing = new RacingTask(blocking);
+		taskManager.addTask(racing);
+		if(!waitFor(racing->done, 1000))
+			return false;
+	}
+
+	return stealsFromBusyWorker(taskManager);
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+
+	{
+		TaskManager taskManager;
+		taskManager.start(2);
+		if(!stealsFromBusyWorker(taskManager))
+		{
+			printf("FAILED: idle worker did not steal from busy worker\n");
+			failed++;
+		}
+		taskManager.stop();
+		taskManager.join();
+	}
+
+	{
+		TaskManager taskManager;
+		taskManager.start(2);
+		if(!stealsAfterLostRace(taskManager))
+		{
+			printf("FAILED: idle worker did not steal after losing a race\n");
+			failed++;
+		}
+		taskManager.stop();
+		taskManager.join();
+	}
+
+	if(failed == 0)
+		printf("All TaskManager tests passed\n");
+	return failed == 0 ? 0 : 1;
+}